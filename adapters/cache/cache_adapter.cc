@@ -0,0 +1,447 @@
+#include "cache_adapter.h"
+#include "kvstore_factory.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+
+static const size_t kLinearBuckets = 16;   // one per nanosecond below this
+static const int kSubBucketBits = 3;       // 8 buckets per power of two
+static const size_t kNumBuckets = kLinearBuckets + (64 - 4) * (1 << kSubBucketBits);
+
+static uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* backendOpName(BackendOp op) {
+    switch (op) {
+        case BackendOp::Get: return "get";
+        case BackendOp::Put: return "put";
+        case BackendOp::Remove: return "remove";
+        case BackendOp::Scan: return "scan";
+        default: return "?";
+    }
+}
+
+static const char* policyName(EvictionPolicy policy) {
+    switch (policy) {
+        case EvictionPolicy::Lru: return "lru";
+        case EvictionPolicy::Clock: return "clock";
+        case EvictionPolicy::S3Fifo: return "s3fifo";
+    }
+    return "?";
+}
+
+LatencyHistogram::LatencyHistogram() : buckets_(kNumBuckets, 0) {}
+
+size_t LatencyHistogram::bucketOf(uint64_t nanos) {
+    if (nanos < kLinearBuckets) {
+        return nanos;
+    }
+    int exponent = 63 - __builtin_clzll(nanos);
+    uint64_t sub = (nanos >> (exponent - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+    return kLinearBuckets + (exponent - 4) * (1 << kSubBucketBits) + sub;
+}
+
+uint64_t LatencyHistogram::bucketStart(size_t bucket) {
+    if (bucket < kLinearBuckets) {
+        return bucket;
+    }
+    size_t exponent = (bucket - kLinearBuckets) / (1 << kSubBucketBits) + 4;
+    uint64_t sub = (bucket - kLinearBuckets) % (1 << kSubBucketBits);
+    return ((1ULL << kSubBucketBits) + sub) << (exponent - kSubBucketBits);
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    buckets_[bucketOf(nanos)]++;
+    count_++;
+    sumNanos_ += nanos;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sumNanos_ += other.sumNanos_;
+}
+
+double LatencyHistogram::avgMicros() const {
+    return count_ > 0 ? static_cast<double>(sumNanos_) / count_ / 1e3 : 0.0;
+}
+
+// The middle of the bucket holding the percentile.
+double LatencyHistogram::percentileMicros(double percentile) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            uint64_t start = bucketStart(i);
+            uint64_t end = i + 1 < kNumBuckets ? bucketStart(i + 1) : start;
+            return (start + (end - start) / 2.0) / 1e3;
+        }
+    }
+    return 0.0;
+}
+
+void CacheStats::merge(const CacheStats& other) {
+    gets += other.gets;
+    hits += other.hits;
+    hitLatency.merge(other.hitLatency);
+    missLatency.merge(other.missLatency);
+    for (int i = 0; i < static_cast<int>(BackendOp::NumOps); i++) {
+        backendLatency[i].merge(other.backendLatency[i]);
+    }
+}
+
+bool CacheStats::empty() const {
+    for (const auto& latency : backendLatency) {
+        if (latency.count() > 0) {
+            return false;
+        }
+    }
+    return gets == 0;
+}
+
+CacheSession::CacheSession(CacheAdapter* cache, KVSession* backend, std::unique_ptr<KVSession> ownedBackend)
+    : cache_(cache), backend_(backend), ownedBackend_(std::move(ownedBackend)) {}
+
+CacheSession::~CacheSession() {
+    cache_->mergeStats(stats_);
+}
+
+std::unique_lock<std::mutex> CacheSession::lockBackend() {
+    if (cache_->backendSafety_ == ThreadSafety::Serialized) {
+        return std::unique_lock<std::mutex>(cache_->backendMutex_);
+    }
+    return std::unique_lock<std::mutex>();
+}
+
+Result CacheSession::read(const std::string& key, std::string* value) {
+    uint64_t start = nowNanos();
+    CacheShard& shard = cache_->shardOf(key);
+    uint64_t token;
+    stats_.gets++;
+    if (shard.lookup(key, value, &token)) {
+        stats_.hits++;
+        stats_.hitLatency.record(nowNanos() - start);
+        return Result::OK();
+    }
+
+    std::string fetched;
+    uint64_t backendStart = nowNanos();
+    Result r = Result::OK();
+    {
+        auto lock = lockBackend();
+        r = backend_->getValue(key, &fetched);
+    }
+    uint64_t end = nowNanos();
+    stats_.backendLatency[static_cast<int>(BackendOp::Get)].record(end - backendStart);
+    if (r.ok()) {
+        shard.fill(key, fetched, token);
+        if (value != nullptr) {
+            *value = std::move(fetched);
+        }
+    } else {
+        shard.release(key);
+    }
+    stats_.missLatency.record(nowNanos() - start);
+    return r;
+}
+
+Result CacheSession::get(const std::string& key) {
+    return read(key, nullptr);
+}
+
+Result CacheSession::getValue(const std::string& key, std::string* value) {
+    return read(key, value);
+}
+
+Result CacheSession::put(const std::string& key, const std::string& value) {
+    CacheShard& shard = cache_->shardOf(key);
+    uint64_t token = cache_->writeThrough_ ? shard.beginWrite(key) : 0;
+    uint64_t start = nowNanos();
+    Result r = Result::OK();
+    {
+        auto lock = lockBackend();
+        r = backend_->put(key, value);
+    }
+    stats_.backendLatency[static_cast<int>(BackendOp::Put)].record(nowNanos() - start);
+    if (cache_->writeThrough_ && r.ok()) {
+        shard.update(key, value, token);
+    } else {
+        shard.invalidate(key);
+        if (cache_->writeThrough_) {
+            shard.release(key);
+        }
+    }
+    return r;
+}
+
+Result CacheSession::remove(const std::string& key) {
+    uint64_t start = nowNanos();
+    Result r = Result::OK();
+    {
+        auto lock = lockBackend();
+        r = backend_->remove(key);
+    }
+    stats_.backendLatency[static_cast<int>(BackendOp::Remove)].record(nowNanos() - start);
+    cache_->shardOf(key).invalidate(key);
+    return r;
+}
+
+Result CacheSession::scan(const std::string& start, const std::string& end) {
+    uint64_t begin = nowNanos();
+    Result r = Result::OK();
+    {
+        auto lock = lockBackend();
+        r = backend_->scan(start, end);
+    }
+    stats_.backendLatency[static_cast<int>(BackendOp::Scan)].record(nowNanos() - begin);
+    return r;
+}
+
+CacheAdapter::~CacheAdapter() {
+    direct_.reset();
+    // ops no step report covered, as when the adapter is used on its own
+    if (!shards_.empty() && !stats_.empty()) {
+        printf("%s", takeStepReport().c_str());
+    }
+}
+
+// Splits the options into the cache's own and the backend's.
+Result CacheAdapter::parseOptions(const std::map<std::string, std::string>& options,
+                                  std::map<std::string, std::string>* backendOptions) {
+    for (const auto& option : options) {
+        if (option.first == "backend") {
+            backendName_ = option.second;
+        } else if (option.first == "capacity") {
+            capacity_ = std::stoull(option.second);
+        } else if (option.first == "shards") {
+            numShards_ = std::stoul(option.second);
+        } else if (option.first == "policy") {
+            if (option.second == "lru") {
+                policy_ = EvictionPolicy::Lru;
+            } else if (option.second == "clock") {
+                policy_ = EvictionPolicy::Clock;
+            } else if (option.second == "s3fifo") {
+                policy_ = EvictionPolicy::S3Fifo;
+            } else {
+                return Result::Error("Unknown cache policy: " + option.second);
+            }
+        } else if (option.first == "write") {
+            if (option.second != "through" && option.second != "around") {
+                return Result::Error("Unknown cache write policy: " + option.second);
+            }
+            writeThrough_ = option.second == "through";
+        } else {
+            backendOptions->insert(option);
+        }
+    }
+    if (backendName_.empty()) {
+        return Result::Error("cache needs --cache-backend=<adapter>");
+    }
+    *backendOptions = forwardedOptions(backendName_, *backendOptions);
+    if (backendName_ == "cache") {
+        return Result::Error("cache cannot be its own backend");
+    }
+    if (numShards_ == 0 || capacity_ < numShards_) {
+        return Result::Error("cache needs at least one shard and a byte of capacity per shard");
+    }
+    return Result::OK();
+}
+
+Result CacheAdapter::init(std::map<std::string, std::string> options) {
+    std::map<std::string, std::string> backendOptions;
+    Result r = Result::OK();
+    try {
+        r = parseOptions(options, &backendOptions);
+    } catch (const std::exception&) {
+        return Result::Error("Invalid cache option");
+    }
+    if (!r.ok()) {
+        return r;
+    }
+
+    try {
+        backend_ = KVStoreFactory::instance().create(backendName_);
+    } catch (const std::exception& e) {
+        return Result::Error(e.what());
+    }
+    if (reuse_) {
+        r = backend_->reuseData();
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    r = backend_->init(backendOptions);
+    if (!r.ok()) {
+        return r;
+    }
+    backendSafety_ = backend_->threadSafety();
+
+    for (size_t i = 0; i < numShards_; i++) {
+        shards_.push_back(std::make_unique<CacheShard>(policy_, capacity_ / numShards_));
+    }
+    return Result::OK();
+}
+
+CacheShard& CacheAdapter::shardOf(const std::string& key) {
+    return *shards_[std::hash<std::string>()(key) % shards_.size()];
+}
+
+Result CacheAdapter::openSession(std::unique_ptr<KVSession>& session) {
+    std::unique_ptr<KVSession> backendSession;
+    KVSession* backend = backend_.get();
+    if (backendSafety_ == ThreadSafety::PerThread) {
+        Result r = backend_->openSession(backendSession);
+        if (!r.ok()) {
+            return r;
+        }
+        backend = backendSession.get();
+    }
+    session = std::make_unique<CacheSession>(this, backend, std::move(backendSession));
+    return Result::OK();
+}
+
+KVSession* CacheAdapter::direct() {
+    if (direct_ == nullptr) {
+        std::unique_ptr<KVSession> session;
+        Result r = openSession(session);
+        if (!r.ok()) {
+            return nullptr;
+        }
+        direct_.reset(static_cast<CacheSession*>(session.release()));
+    }
+    return direct_.get();
+}
+
+Result CacheAdapter::put(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->put(key, value) : Result::Error("Cannot open a cache session");
+}
+
+Result CacheAdapter::get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->get(key) : Result::Error("Cannot open a cache session");
+}
+
+Result CacheAdapter::getValue(const std::string& key, std::string* value) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->getValue(key, value) : Result::Error("Cannot open a cache session");
+}
+
+Result CacheAdapter::remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->remove(key) : Result::Error("Cannot open a cache session");
+}
+
+Result CacheAdapter::scan(const std::string& start, const std::string& end) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->scan(start, end) : Result::Error("Cannot open a cache session");
+}
+
+Result CacheAdapter::reuseData() {
+    reuse_ = true;
+    return Result::OK();
+}
+
+bool CacheAdapter::startedFresh() const {
+    return backend_ == nullptr || backend_->startedFresh();
+}
+
+std::string CacheAdapter::dataDirectory() const {
+    return backend_ != nullptr ? backend_->dataDirectory() : "";
+}
+
+// That of the backend the options name, asked of an instance never initialized.
+std::string CacheAdapter::defaultDataDirectory(const std::map<std::string, std::string>& options) const {
+    auto backend = options.find("backend");
+    if (backend == options.end() || backend->second == "cache") {
+        return "";
+    }
+    std::map<std::string, std::string> rest = options;
+    rest.erase("backend");
+    try {
+        return KVStoreFactory::instance().create(backend->second)->defaultDataDirectory(
+            forwardedOptions(backend->second, rest));
+    } catch (const std::exception&) {
+        return "";
+    }
+}
+
+Result CacheAdapter::quiesce() {
+    return backend_->quiesce();
+}
+
+void CacheAdapter::mergeStats(const CacheStats& stats) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.merge(stats);
+}
+
+// printf to the end of a string.
+static void appendf(std::string* out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    *out += line;
+}
+
+static void reportLatency(std::string* out, const char* name, const LatencyHistogram& latency) {
+    appendf(out, "   %-11s: %llu ops, avg %.3f, p50 %.3f, p99 %.3f, p99.9 %.3f µs\n", name,
+            static_cast<unsigned long long>(latency.count()), latency.avgMicros(),
+            latency.percentileMicros(50), latency.percentileMicros(99), latency.percentileMicros(99.9));
+}
+
+std::string CacheAdapter::takeStepReport() {
+    // ops made through the adapter itself count too
+    {
+        std::lock_guard<std::mutex> lock(directMutex_);
+        direct_.reset();
+    }
+    uint64_t entries = 0, bytes = 0, evictions = 0;
+    for (auto& shard : shards_) {
+        entries += shard->entries();
+        bytes += shard->bytes();
+        evictions += shard->evictions();
+    }
+
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        appendf(&out, "Cache (%s, write-%s, %.1f MB in %zu shards):\n", policyName(policy_),
+                writeThrough_ ? "through" : "around", capacity_ / 1048576.0, numShards_);
+        appendf(&out, "   Cached     : %llu entries, %.1f MB, %llu evictions\n",
+                static_cast<unsigned long long>(entries), bytes / 1048576.0,
+                static_cast<unsigned long long>(evictions - reportedEvictions_));
+        appendf(&out, "   Reads      : %llu, hit %.1f%%\n", static_cast<unsigned long long>(stats_.gets),
+                stats_.gets > 0 ? 100.0 * stats_.hits / stats_.gets : 0.0);
+        if (stats_.gets > 0) {
+            reportLatency(&out, "Hits", stats_.hitLatency);
+            reportLatency(&out, "Misses", stats_.missLatency);
+        }
+        for (int i = 0; i < static_cast<int>(BackendOp::NumOps); i++) {
+            if (stats_.backendLatency[i].count() > 0) {
+                std::string name = std::string("Backend ") + backendOpName(static_cast<BackendOp>(i));
+                reportLatency(&out, name.c_str(), stats_.backendLatency[i]);
+            }
+        }
+        stats_ = CacheStats();
+        reportedEvictions_ = evictions;
+    }
+    return out + backend_->takeStepReport();
+}
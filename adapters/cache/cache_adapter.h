@@ -0,0 +1,147 @@
+#ifndef CACHE_ADAPTER_H
+#define CACHE_ADAPTER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cache_shard.h"
+#include "kvstore.h"
+#include "result.h"
+
+// Log-linear latency histogram in nanoseconds: 8 buckets per power of two,
+// so percentiles are within about 6% of the exact ones.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t nanos);
+    void merge(const LatencyHistogram& other);
+    uint64_t count() const { return count_; }
+    double avgMicros() const;
+    double percentileMicros(double percentile) const;
+
+private:
+    static size_t bucketOf(uint64_t nanos);
+    static uint64_t bucketStart(size_t bucket);
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t sumNanos_ = 0;
+};
+
+// Backend ops whose latency the cache reports.
+enum class BackendOp { Get, Put, Remove, Scan, NumOps };
+
+// What one session saw; merged into the adapter's totals when it closes.
+struct CacheStats {
+    uint64_t gets = 0;
+    uint64_t hits = 0;
+    LatencyHistogram hitLatency;     // gets served from the cache
+    LatencyHistogram missLatency;    // gets that went to the backend, whole op
+    LatencyHistogram backendLatency[static_cast<int>(BackendOp::NumOps)];  // backend calls alone
+
+    void merge(const CacheStats& other);
+    // No op went through the cache.
+    bool empty() const;
+};
+
+class CacheAdapter;
+
+// CacheSession serves one worker thread: reads go to the cache first, and
+// everything else to the backend through the thread's backend session.
+class CacheSession : public KVSession {
+public:
+    CacheSession(CacheAdapter* cache, KVSession* backend, std::unique_ptr<KVSession> ownedBackend);
+    ~CacheSession() override;
+
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+
+private:
+    Result read(const std::string& key, std::string* value);
+    // Locks the backend if it is not thread-safe.
+    std::unique_lock<std::mutex> lockBackend();
+
+    CacheAdapter* cache_;
+    KVSession* backend_;
+    std::unique_ptr<KVSession> ownedBackend_;
+    CacheStats stats_;
+};
+
+// CacheAdapter puts a sharded, size-bounded in-process cache in front of
+// another adapter, created through KVStoreFactory, to estimate the hit rate
+// and latency a front-side cache would give for a workload's skew. It reports
+// hits and the latency of hits, misses and backend calls with the results of
+// every workload step.
+//
+// Options (--cache-<option>=<value>):
+//   backend    the adapter behind the cache (required)
+//   capacity   bytes of keys, values and per-entry overhead, 64 MB by default
+//   shards     independently locked parts of the cache, 16 by default
+//   policy     lru (default), clock or s3fifo
+//   write      through (default): writes update the cached value;
+//              around: writes drop it, and the next read fills it
+// Any other option is passed to the backend, without its "<backend>-"
+// prefix if it has one (see forwardedOptions).
+//
+// Every thread goes through a session of its own, which keeps its stats;
+// scans always go to the backend.
+class CacheAdapter : public KVStore {
+public:
+    CacheAdapter() = default;
+    ~CacheAdapter() override;
+
+    Result init(std::map<std::string, std::string> options) override;
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+
+    ThreadSafety threadSafety() const override { return ThreadSafety::PerThread; }
+    Result openSession(std::unique_ptr<KVSession>& session) override;
+    Result reuseData() override;
+    bool startedFresh() const override;
+    std::string dataDirectory() const override;
+    std::string defaultDataDirectory(const std::map<std::string, std::string>& options) const override;
+    Result quiesce() override;
+    std::string takeStepReport() override;
+
+private:
+    friend class CacheSession;
+
+    Result parseOptions(const std::map<std::string, std::string>& options,
+                        std::map<std::string, std::string>* backendOptions);
+    CacheShard& shardOf(const std::string& key);
+    // Opens the session direct calls on the adapter go through.
+    KVSession* direct();
+    void mergeStats(const CacheStats& stats);
+
+    // Options
+    std::string backendName_;
+    uint64_t capacity_ = 64 << 20;
+    size_t numShards_ = 16;
+    EvictionPolicy policy_ = EvictionPolicy::Lru;
+    bool writeThrough_ = true;
+
+    bool reuse_ = false;          // open the backend's data from a previous run
+    std::unique_ptr<KVStore> backend_;
+    ThreadSafety backendSafety_ = ThreadSafety::Shared;
+    std::mutex backendMutex_;    // serializes a backend that is not thread-safe
+    std::vector<std::unique_ptr<CacheShard>> shards_;
+
+    std::mutex directMutex_;
+    std::unique_ptr<CacheSession> direct_;
+
+    std::mutex statsMutex_;
+    CacheStats stats_;           // of the sessions closed since the last step report
+    uint64_t reportedEvictions_ = 0;
+};
+
+#endif // CACHE_ADAPTER_H
@@ -0,0 +1,221 @@
+#include "cache_shard.h"
+
+#include <algorithm>
+#include <iterator>
+
+// Bookkeeping per entry: the queue node, the index node and the key copy the
+// index holds, roughly.
+static const uint64_t kEntryOverhead = 96;
+
+// S3-FIFO's small queue holds a tenth of the shard.
+static const uint64_t kSmallQueueShare = 10;
+
+// Reads counted per entry, as in S3-FIFO.
+static const uint8_t kMaxFreq = 3;
+
+CacheShard::CacheShard(EvictionPolicy policy, uint64_t capacity) : policy_(policy), capacity_(capacity) {}
+
+uint64_t CacheShard::charge(const Entry& entry) {
+    return entry.key.size() + entry.value.size() + kEntryOverhead;
+}
+
+bool CacheShard::lookup(const std::string& key, std::string* value, uint64_t* token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found == index_.end()) {
+        *token = acquire(key);
+        return false;
+    }
+    Queue::iterator entry = found->second;
+    switch (policy_) {
+        case EvictionPolicy::Lru:
+            main_.splice(main_.begin(), main_, entry);
+            break;
+        case EvictionPolicy::Clock:
+            entry->freq = 1;
+            break;
+        case EvictionPolicy::S3Fifo:
+            entry->freq = std::min<uint8_t>(entry->freq + 1, kMaxFreq);
+            break;
+    }
+    if (value != nullptr) {
+        *value = entry->value;
+    }
+    return true;
+}
+
+uint64_t CacheShard::beginWrite(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return acquire(key);
+}
+
+// Registers an op in flight on key, and returns the key's version.
+uint64_t CacheShard::acquire(const std::string& key) {
+    Pending& pending = pending_[key];
+    pending.refs++;
+    return pending.version;
+}
+
+void CacheShard::release(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    releaseLocked(key);
+}
+
+void CacheShard::releaseLocked(const std::string& key) {
+    auto pending = pending_.find(key);
+    if (pending != pending_.end() && --pending->second.refs == 0) {
+        pending_.erase(pending);
+    }
+}
+
+void CacheShard::fill(const std::string& key, const std::string& value, uint64_t token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // a filled key left in place by a concurrent fill holds the same value
+    if (pending_[key].version == token && index_.count(key) == 0) {
+        insert(key, value);
+    }
+    releaseLocked(key);
+}
+
+void CacheShard::update(const std::string& key, const std::string& value, uint64_t token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Pending& pending = pending_[key];
+    bool raced = pending.version != token;
+    pending.version++;
+    auto found = index_.find(key);
+    if (raced) {
+        if (found != index_.end()) {
+            erase(found->second);
+        }
+    } else if (found == index_.end()) {
+        insert(key, value);
+    } else {
+        replace(found->second, value);
+    }
+    releaseLocked(key);
+}
+
+void CacheShard::replace(Queue::iterator entry, const std::string& value) {
+    bytes_ -= charge(*entry);
+    if (entry->small) {
+        smallBytes_ -= charge(*entry);
+    }
+    entry->value = value;
+    bytes_ += charge(*entry);
+    if (entry->small) {
+        smallBytes_ += charge(*entry);
+    }
+    while (bytes_ > capacity_ && !index_.empty()) {
+        evict();
+    }
+}
+
+void CacheShard::invalidate(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // reads and writes in flight must not cache what they saw before
+    auto pending = pending_.find(key);
+    if (pending != pending_.end()) {
+        pending->second.version++;
+    }
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        erase(found->second);
+    }
+}
+
+uint64_t CacheShard::entries() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+uint64_t CacheShard::bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+uint64_t CacheShard::evictions() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evictions_;
+}
+
+void CacheShard::insert(const std::string& key, const std::string& value) {
+    Queue* queue = &main_;
+    bool small = false;
+    if (policy_ == EvictionPolicy::S3Fifo) {
+        // keys evicted from the small queue lately go straight to the main one
+        auto ghost = ghostIndex_.find(key);
+        if (ghost != ghostIndex_.end()) {
+            ghosts_.erase(ghost->second);
+            ghostIndex_.erase(ghost);
+        } else {
+            queue = &small_;
+            small = true;
+        }
+    }
+    queue->push_front(Entry{key, value, 0, small});
+    Queue::iterator entry = queue->begin();
+    index_[key] = entry;
+    bytes_ += charge(*entry);
+    if (small) {
+        smallBytes_ += charge(*entry);
+    }
+    while (bytes_ > capacity_ && !index_.empty()) {
+        evict();
+    }
+}
+
+void CacheShard::erase(Queue::iterator entry) {
+    bytes_ -= charge(*entry);
+    if (entry->small) {
+        smallBytes_ -= charge(*entry);
+    }
+    index_.erase(entry->key);
+    (entry->small ? small_ : main_).erase(entry);
+}
+
+// Evicts one entry, moving entries between or within the queues first as
+// the policy asks.
+void CacheShard::evict() {
+    for (;;) {
+        if (policy_ == EvictionPolicy::S3Fifo && !small_.empty() &&
+            (smallBytes_ > capacity_ / kSmallQueueShare || main_.empty())) {
+            Queue::iterator entry = std::prev(small_.end());
+            if (entry->freq > 0) {
+                smallBytes_ -= charge(*entry);
+                entry->freq = 0;
+                entry->small = false;
+                main_.splice(main_.begin(), small_, entry);
+                continue;
+            }
+            remember(entry->key);
+            erase(entry);
+            evictions_++;
+            return;
+        }
+
+        Queue::iterator entry = std::prev(main_.end());
+        if (policy_ != EvictionPolicy::Lru && entry->freq > 0) {
+            // CLOCK clears the reference bit, S3-FIFO counts one read off
+            entry->freq = policy_ == EvictionPolicy::Clock ? 0 : entry->freq - 1;
+            main_.splice(main_.begin(), main_, entry);
+            continue;
+        }
+        erase(entry);
+        evictions_++;
+        return;
+    }
+}
+
+// Adds key to the ghost queue, which remembers as many keys as the shard
+// holds entries.
+void CacheShard::remember(const std::string& key) {
+    if (ghostIndex_.count(key) > 0) {
+        return;
+    }
+    ghosts_.push_front(key);
+    ghostIndex_[key] = ghosts_.begin();
+    while (ghosts_.size() > std::max<size_t>(index_.size(), 1)) {
+        ghostIndex_.erase(ghosts_.back());
+        ghosts_.pop_back();
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef CACHE_SHARD_H
+#define CACHE_SHARD_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Which entry a full cache shard gives up.
+enum class EvictionPolicy {
+    Lru,     // the least recently used one
+    Clock,   // the oldest one not referenced since the hand last passed it
+    S3Fifo   // S3-FIFO: new keys go through a small FIFO first, and only keys
+             // read again while in it, or recently evicted from it, reach the
+             // main FIFO
+};
+
+// CacheShard is one lock-protected part of the cache, bounded by the bytes
+// of the keys and values it holds plus a fixed overhead per entry.
+//
+// Fills racing with writes must not leave a stale value behind. A read that
+// misses and a write-through write register as in flight on their key and
+// get a token, the key's version. Every write of the key bumps its version,
+// and a fill or write only updates the cache if the key's version is still
+// the one of its token; otherwise the key is dropped from the cache instead.
+// Keys are only tracked while ops on them are in flight.
+class CacheShard {
+public:
+    CacheShard(EvictionPolicy policy, uint64_t capacity);
+
+    // Looks key up, copying its value to value if not null. On a miss,
+    // registers a read of key in flight and sets the token its fill must
+    // present; fill or release must follow.
+    bool lookup(const std::string& key, std::string* value, uint64_t* token);
+    // Registers a write of key in flight and returns the token update must
+    // present; update or release must follow.
+    uint64_t beginWrite(const std::string& key);
+    // Caches the value read from the backend, unless a write got in between,
+    // and ends the read.
+    void fill(const std::string& key, const std::string& value, uint64_t token);
+    // Caches the value written to the backend, or drops the key if another
+    // write got in between, and ends the write.
+    void update(const std::string& key, const std::string& value, uint64_t token);
+    // Ends a read or write that failed, without caching anything.
+    void release(const std::string& key);
+    // Drops key after a write that bypassed the cache, a failed write or a
+    // remove.
+    void invalidate(const std::string& key);
+
+    uint64_t entries();
+    uint64_t bytes();
+    uint64_t evictions();
+
+private:
+    struct Entry {
+        std::string key;
+        std::string value;
+        uint8_t freq = 0;       // reads since insertion, capped; CLOCK's reference bit
+        bool small = false;     // in S3-FIFO's small queue
+    };
+    using Queue = std::list<Entry>;
+
+    static uint64_t charge(const Entry& entry);
+    void insert(const std::string& key, const std::string& value);
+    void replace(Queue::iterator entry, const std::string& value);
+    void erase(Queue::iterator entry);
+    void evict();
+    void remember(const std::string& key);
+    uint64_t acquire(const std::string& key);
+    void releaseLocked(const std::string& key);
+
+    // A key with ops in flight.
+    struct Pending {
+        uint64_t version = 0;   // bumped by every write of the key
+        uint32_t refs = 0;      // reads and writes in flight
+    };
+
+    EvictionPolicy policy_;
+    uint64_t capacity_;
+    std::mutex mutex_;
+    uint64_t bytes_ = 0;
+    uint64_t smallBytes_ = 0;
+    uint64_t evictions_ = 0;
+    // Entries are inserted at the front and evicted from the back. LRU and
+    // CLOCK only use main_.
+    Queue main_;
+    Queue small_;
+    std::unordered_map<std::string, Queue::iterator> index_;
+    std::unordered_map<std::string, Pending> pending_;
+    // S3-FIFO's ghost queue: keys recently evicted from the small queue.
+    std::list<std::string> ghosts_;
+    std::unordered_map<std::string, std::list<std::string>::iterator> ghostIndex_;
+};
+
+#endif // CACHE_SHARD_H
@@ -0,0 +1,10 @@
+#include "cache_adapter.h"
+#include "kvstore_factory.h"
+#include <memory>
+
+extern "C" void registerAdapters(KVStoreFactory& factory) {
+    factory.registerAdapter(
+        "cache", [](){
+        return std::make_unique<CacheAdapter>();
+    });
+}
@@ -0,0 +1,376 @@
+#include "delay_adapter.h"
+#include "kvstore_factory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+
+// The clock of the timer waits, so that deadlines and sleeps agree.
+static uint64_t nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+void DelayStats::merge(const DelayStats& other) {
+    ops += other.ops;
+    requestedNanos += other.requestedNanos;
+    overshootNanos += other.overshootNanos;
+    maxOvershootNanos = std::max(maxOvershootNanos, other.maxOvershootNanos);
+    queued += other.queued;
+    queuedNanos += other.queuedNanos;
+}
+
+DelaySession::DelaySession(DelayAdapter* adapter, KVSession* backend, std::unique_ptr<KVSession> ownedBackend,
+                           std::unique_ptr<BaseDistribution> delays)
+    : adapter_(adapter), backend_(backend), ownedBackend_(std::move(ownedBackend)), delays_(std::move(delays)) {}
+
+DelaySession::~DelaySession() {
+    adapter_->mergeStats(stats_);
+}
+
+void DelaySession::waitUntil(uint64_t deadline) {
+    if (adapter_->waitMode_ == WaitMode::Timer) {
+        sleepUntil(deadline);
+        return;
+    }
+    if (adapter_->waitMode_ == WaitMode::Hybrid && deadline > nowNanos() + adapter_->spinNanos_) {
+        sleepUntil(deadline - adapter_->spinNanos_);
+    }
+    while (nowNanos() < deadline) {
+    }
+}
+
+template <typename Op>
+Result DelaySession::delayed(Op op) {
+    uint64_t concurrency = adapter_->concurrency_;
+    if (concurrency > 0) {
+        std::unique_lock<std::mutex> lock(adapter_->slotMutex_);
+        if (adapter_->inFlight_ >= concurrency) {
+            uint64_t start = nowNanos();
+            adapter_->slotFreed_.wait(lock, [&] { return adapter_->inFlight_ < concurrency; });
+            stats_.queued++;
+            stats_.queuedNanos += nowNanos() - start;
+        }
+        adapter_->inFlight_++;
+    }
+
+    uint64_t delay = delays_->Generate(rng_) * 1000;
+    stats_.ops++;
+    stats_.requestedNanos += delay;
+    if (delay > 0) {
+        uint64_t deadline = nowNanos() + delay;
+        waitUntil(deadline);
+        uint64_t overshoot = nowNanos() - deadline;
+        stats_.overshootNanos += overshoot;
+        stats_.maxOvershootNanos = std::max(stats_.maxOvershootNanos, overshoot);
+    }
+
+    Result r = Result::OK();
+    if (adapter_->backendSafety_ == ThreadSafety::Serialized) {
+        std::lock_guard<std::mutex> lock(adapter_->backendMutex_);
+        r = op();
+    } else {
+        r = op();
+    }
+
+    if (concurrency > 0) {
+        {
+            std::lock_guard<std::mutex> lock(adapter_->slotMutex_);
+            adapter_->inFlight_--;
+        }
+        adapter_->slotFreed_.notify_one();
+    }
+    return r;
+}
+
+Result DelaySession::put(const std::string& key, const std::string& value) {
+    return delayed([&] { return backend_->put(key, value); });
+}
+
+Result DelaySession::get(const std::string& key) {
+    return delayed([&] { return backend_->get(key); });
+}
+
+Result DelaySession::getValue(const std::string& key, std::string* value) {
+    return delayed([&] { return backend_->getValue(key, value); });
+}
+
+Result DelaySession::remove(const std::string& key) {
+    return delayed([&] { return backend_->remove(key); });
+}
+
+Result DelaySession::scan(const std::string& start, const std::string& end) {
+    return delayed([&] { return backend_->scan(start, end); });
+}
+
+DelayAdapter::~DelayAdapter() {
+    direct_.reset();
+    // ops no step report covered, as when the adapter is used on its own
+    if (backend_ != nullptr && stats_.ops > 0) {
+        printf("%s", takeStepReport().c_str());
+    }
+}
+
+// Splits the options into the adapter's own and the backend's.
+Result DelayAdapter::parseOptions(const std::map<std::string, std::string>& options,
+                                  std::map<std::string, std::string>* backendOptions) {
+    bool hasMax = false;
+    for (const auto& option : options) {
+        if (option.first == "backend") {
+            backendName_ = option.second;
+        } else if (option.first == "delay") {
+            if (option.second == "fixed") {
+                delayType_ = DistributionType::Fixed;
+            } else if (option.second == "uniform") {
+                delayType_ = DistributionType::Uniform;
+            } else if (option.second == "normal") {
+                delayType_ = DistributionType::Normal;
+            } else if (option.second == "pareto") {
+                delayType_ = DistributionType::Pareto;
+            } else if (option.second == "histogram") {
+                delayType_ = DistributionType::Empirical;
+            } else {
+                return Result::Error("Unknown delay distribution: " + option.second);
+            }
+        } else if (option.first == "delay_us") {
+            delayMicros_ = std::stoull(option.second);
+        } else if (option.first == "delay_min_us") {
+            delayMinMicros_ = std::stoull(option.second);
+        } else if (option.first == "delay_max_us") {
+            delayMaxMicros_ = std::stoull(option.second);
+            hasMax = true;
+        } else if (option.first == "pareto_scale") {
+            paretoScale_ = std::stod(option.second);
+        } else if (option.first == "pareto_shape") {
+            paretoShape_ = std::stod(option.second);
+        } else if (option.first == "delay_histogram") {
+            histogramPath_ = option.second;
+        } else if (option.first == "concurrency") {
+            concurrency_ = std::stoull(option.second);
+        } else if (option.first == "wait") {
+            if (option.second == "spin") {
+                waitMode_ = WaitMode::Spin;
+            } else if (option.second == "timer") {
+                waitMode_ = WaitMode::Timer;
+            } else if (option.second == "hybrid") {
+                waitMode_ = WaitMode::Hybrid;
+            } else {
+                return Result::Error("Unknown delay wait mode: " + option.second);
+            }
+        } else if (option.first == "spin_us") {
+            spinNanos_ = std::stoull(option.second) * 1000;
+        } else {
+            backendOptions->insert(option);
+        }
+    }
+    if (backendName_.empty()) {
+        return Result::Error("delay needs --delay-backend=<adapter>");
+    }
+    *backendOptions = forwardedOptions(backendName_, *backendOptions);
+    if (backendName_ == "delay") {
+        return Result::Error("delay cannot be its own backend");
+    }
+    if (delayType_ == DistributionType::Empirical) {
+        if (histogramPath_.empty()) {
+            return Result::Error("delay=histogram needs --delay-delay_histogram=<file>");
+        }
+        return loadHistogram(histogramPath_, histogram_);
+    }
+    if (delayType_ != DistributionType::Fixed && (!hasMax || delayMaxMicros_ < delayMinMicros_)) {
+        return Result::Error("delay needs delay_max_us, at least delay_min_us");
+    }
+    if (delayType_ == DistributionType::Pareto && paretoScale_ <= 0) {
+        return Result::Error("delay pareto_scale must be positive");
+    }
+    return Result::OK();
+}
+
+std::unique_ptr<BaseDistribution> DelayAdapter::newDelayDistribution() const {
+    switch (delayType_) {
+        case DistributionType::Uniform:
+            return std::make_unique<UniformDistribution>(delayMinMicros_, delayMaxMicros_);
+        case DistributionType::Normal:
+            return std::make_unique<NormalDistribution>(delayMinMicros_, delayMaxMicros_);
+        case DistributionType::Pareto:
+            return std::make_unique<ParetoDistribution>(delayMinMicros_, delayMaxMicros_, paretoScale_,
+                                                        paretoShape_);
+        case DistributionType::Empirical:
+            return std::make_unique<EmpiricalDistribution>(histogram_);
+        case DistributionType::Fixed:
+        default:
+            return std::make_unique<FixedDistribution>(delayMicros_);
+    }
+}
+
+Result DelayAdapter::init(std::map<std::string, std::string> options) {
+    std::map<std::string, std::string> backendOptions;
+    Result r = Result::OK();
+    try {
+        r = parseOptions(options, &backendOptions);
+    } catch (const std::exception&) {
+        return Result::Error("Invalid delay option");
+    }
+    if (!r.ok()) {
+        return r;
+    }
+
+    try {
+        backend_ = KVStoreFactory::instance().create(backendName_);
+    } catch (const std::exception& e) {
+        return Result::Error(e.what());
+    }
+    if (reuse_) {
+        r = backend_->reuseData();
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    r = backend_->init(backendOptions);
+    if (!r.ok()) {
+        return r;
+    }
+    backendSafety_ = backend_->threadSafety();
+    return Result::OK();
+}
+
+Result DelayAdapter::openSession(std::unique_ptr<KVSession>& session) {
+    std::unique_ptr<KVSession> backendSession;
+    KVSession* backend = backend_.get();
+    if (backendSafety_ == ThreadSafety::PerThread) {
+        Result r = backend_->openSession(backendSession);
+        if (!r.ok()) {
+            return r;
+        }
+        backend = backendSession.get();
+    }
+    session = std::make_unique<DelaySession>(this, backend, std::move(backendSession), newDelayDistribution());
+    return Result::OK();
+}
+
+KVSession* DelayAdapter::direct() {
+    if (direct_ == nullptr) {
+        std::unique_ptr<KVSession> session;
+        Result r = openSession(session);
+        if (!r.ok()) {
+            return nullptr;
+        }
+        direct_.reset(static_cast<DelaySession*>(session.release()));
+    }
+    return direct_.get();
+}
+
+Result DelayAdapter::put(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->put(key, value) : Result::Error("Cannot open a delay session");
+}
+
+Result DelayAdapter::get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->get(key) : Result::Error("Cannot open a delay session");
+}
+
+Result DelayAdapter::getValue(const std::string& key, std::string* value) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->getValue(key, value) : Result::Error("Cannot open a delay session");
+}
+
+Result DelayAdapter::remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->remove(key) : Result::Error("Cannot open a delay session");
+}
+
+Result DelayAdapter::scan(const std::string& start, const std::string& end) {
+    std::lock_guard<std::mutex> lock(directMutex_);
+    KVSession* session = direct();
+    return session != nullptr ? session->scan(start, end) : Result::Error("Cannot open a delay session");
+}
+
+Result DelayAdapter::reuseData() {
+    reuse_ = true;
+    return Result::OK();
+}
+
+bool DelayAdapter::startedFresh() const {
+    return backend_ == nullptr || backend_->startedFresh();
+}
+
+std::string DelayAdapter::dataDirectory() const {
+    return backend_ != nullptr ? backend_->dataDirectory() : "";
+}
+
+// That of the backend the options name, asked of an instance never initialized.
+std::string DelayAdapter::defaultDataDirectory(const std::map<std::string, std::string>& options) const {
+    auto backend = options.find("backend");
+    if (backend == options.end() || backend->second == "delay") {
+        return "";
+    }
+    std::map<std::string, std::string> rest = options;
+    rest.erase("backend");
+    try {
+        return KVStoreFactory::instance().create(backend->second)->defaultDataDirectory(
+            forwardedOptions(backend->second, rest));
+    } catch (const std::exception&) {
+        return "";
+    }
+}
+
+Result DelayAdapter::quiesce() {
+    return backend_->quiesce();
+}
+
+void DelayAdapter::mergeStats(const DelayStats& stats) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.merge(stats);
+}
+
+// printf to the end of a string.
+static void appendf(std::string* out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    *out += line;
+}
+
+std::string DelayAdapter::takeStepReport() {
+    static const char* const waitModes[] = {"spin", "timer", "hybrid"};
+    // ops made through the adapter itself count too
+    {
+        std::lock_guard<std::mutex> lock(directMutex_);
+        direct_.reset();
+    }
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        uint64_t ops = stats_.ops;
+        appendf(&out, "Delay (%s wait):\n", waitModes[static_cast<int>(waitMode_)]);
+        appendf(&out, "   Delayed    : %llu ops, avg %.3f µs requested\n", static_cast<unsigned long long>(ops),
+                ops > 0 ? stats_.requestedNanos / 1e3 / ops : 0.0);
+        appendf(&out, "   Overshoot  : avg %.3f µs, max %.3f µs\n", ops > 0 ? stats_.overshootNanos / 1e3 / ops : 0.0,
+                stats_.maxOvershootNanos / 1e3);
+        if (concurrency_ > 0) {
+            appendf(&out, "   Queued     : %llu ops for one of %llu slots, avg %.3f µs\n",
+                    static_cast<unsigned long long>(stats_.queued), static_cast<unsigned long long>(concurrency_),
+                    stats_.queued > 0 ? stats_.queuedNanos / 1e3 / stats_.queued : 0.0);
+        }
+        stats_ = DelayStats();
+    }
+    return out + backend_->takeStepReport();
+}
@@ -0,0 +1,155 @@
+#ifndef DELAY_ADAPTER_H
+#define DELAY_ADAPTER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "distribution.h"
+#include "kvstore.h"
+#include "result.h"
+
+// How a session waits out an injected delay.
+enum class WaitMode {
+    Spin,    // busy-wait on the clock: precise, but burns a core per waiter
+    Timer,   // sleep on an absolute CLOCK_MONOTONIC deadline
+    Hybrid   // sleep until spin_us before the deadline, then spin
+};
+
+// What the sessions of a run waited; merged into the adapter's totals when
+// they close.
+struct DelayStats {
+    uint64_t ops = 0;
+    uint64_t requestedNanos = 0;   // delays drawn
+    uint64_t overshootNanos = 0;   // waited beyond them
+    uint64_t maxOvershootNanos = 0;
+    uint64_t queued = 0;           // ops that waited for a concurrency slot
+    uint64_t queuedNanos = 0;
+
+    void merge(const DelayStats& other);
+};
+
+class DelayAdapter;
+
+// DelaySession serves one worker thread, with delays drawn from its own copy
+// of the delay distribution.
+class DelaySession : public KVSession {
+public:
+    DelaySession(DelayAdapter* adapter, KVSession* backend, std::unique_ptr<KVSession> ownedBackend,
+                 std::unique_ptr<BaseDistribution> delays);
+    ~DelaySession() override;
+
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+
+private:
+    // Takes a concurrency slot if there is a limit and waits out a delay,
+    // then runs op on the backend; the slot is held until the op ends.
+    template <typename Op>
+    Result delayed(Op op);
+    void waitUntil(uint64_t deadline);
+
+    DelayAdapter* adapter_;
+    KVSession* backend_;
+    std::unique_ptr<KVSession> ownedBackend_;
+    std::unique_ptr<BaseDistribution> delays_;
+    FastRandom rng_;
+    DelayStats stats_;
+};
+
+// DelayAdapter adds a delay to every op of another adapter, created through
+// KVStoreFactory, to see how a workload behaves when each op costs the round
+// trip of a remote store. The delay is waited out before the op reaches the
+// backend, and counts in the op's measured latency like a real round trip.
+//
+// Options (--delay-<option>=<value>):
+//   backend         the adapter behind the delays (required)
+//   delay           fixed (default), uniform, normal, pareto or histogram
+//   delay_us        fixed: the delay of every op
+//   delay_min_us    uniform, normal, pareto: the smallest delay
+//   delay_max_us    uniform, normal, pareto: the largest delay
+//   pareto_scale    pareto: scale in µs, 100 by default
+//   pareto_shape    pareto: 0 (default) for an exponential tail, more for a
+//                   heavier one
+//   delay_histogram histogram: file of "<µs> <weight>" or
+//                   "<min µs> <max µs> <weight>" lines, as --value_size_histogram
+//   concurrency     ops let through at once, like a connection pool; 0 (the
+//                   default) for no limit
+//   wait            hybrid (default), spin or timer
+//   spin_us         hybrid: how long before the deadline to start spinning,
+//                   50 by default
+// Any other option is passed to the backend, without its "<backend>-"
+// prefix if it has one (see forwardedOptions).
+//
+// Delays run to absolute deadlines, so the cost of waking up is absorbed
+// rather than added; what remains is reported as overshoot with the results
+// of every workload step.
+class DelayAdapter : public KVStore {
+public:
+    DelayAdapter() = default;
+    ~DelayAdapter() override;
+
+    Result init(std::map<std::string, std::string> options) override;
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+
+    ThreadSafety threadSafety() const override { return ThreadSafety::PerThread; }
+    Result openSession(std::unique_ptr<KVSession>& session) override;
+    Result reuseData() override;
+    bool startedFresh() const override;
+    std::string dataDirectory() const override;
+    std::string defaultDataDirectory(const std::map<std::string, std::string>& options) const override;
+    Result quiesce() override;
+    std::string takeStepReport() override;
+
+private:
+    friend class DelaySession;
+
+    Result parseOptions(const std::map<std::string, std::string>& options,
+                        std::map<std::string, std::string>* backendOptions);
+    std::unique_ptr<BaseDistribution> newDelayDistribution() const;
+    // Opens the session direct calls on the adapter go through.
+    KVSession* direct();
+    void mergeStats(const DelayStats& stats);
+
+    // Options
+    std::string backendName_;
+    DistributionType delayType_ = DistributionType::Fixed;
+    uint64_t delayMicros_ = 0;
+    uint64_t delayMinMicros_ = 0;
+    uint64_t delayMaxMicros_ = 0;
+    double paretoScale_ = 100.0;
+    double paretoShape_ = 0.0;
+    std::string histogramPath_;
+    std::vector<HistogramBucket> histogram_;
+    uint64_t concurrency_ = 0;
+    WaitMode waitMode_ = WaitMode::Hybrid;
+    uint64_t spinNanos_ = 50000;
+
+    bool reuse_ = false;          // open the backend's data from a previous run
+    std::unique_ptr<KVStore> backend_;
+    ThreadSafety backendSafety_ = ThreadSafety::Shared;
+    std::mutex backendMutex_;     // serializes a backend that is not thread-safe
+
+    // Concurrency slots
+    std::mutex slotMutex_;
+    std::condition_variable slotFreed_;
+    uint64_t inFlight_ = 0;
+
+    std::mutex directMutex_;
+    std::unique_ptr<DelaySession> direct_;
+
+    std::mutex statsMutex_;
+    DelayStats stats_;            // of the sessions closed since the last step report
+};
+
+#endif // DELAY_ADAPTER_H
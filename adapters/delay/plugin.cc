@@ -0,0 +1,10 @@
+#include "delay_adapter.h"
+#include "kvstore_factory.h"
+#include <memory>
+
+extern "C" void registerAdapters(KVStoreFactory& factory) {
+    factory.registerAdapter(
+        "delay", [](){
+        return std::make_unique<DelayAdapter>();
+    });
+}
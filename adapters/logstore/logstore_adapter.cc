@@ -0,0 +1,644 @@
+#include "logstore_adapter.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Record layout: checksum | key size | value size | type | key | value.
+// All integers are little-endian, as written by the host.
+static const size_t kHeaderSize = 4 + 4 + 4 + 1;
+static const uint8_t kTypePut = 1;
+static const uint8_t kTypeDelete = 2;
+
+// FNV-1a over everything that follows the checksum field.
+static uint32_t checksum(const char* data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Result errnoError(const std::string& what) {
+    return Result::Error(what + ": " + std::strerror(errno));
+}
+
+static Result preadFull(int fd, char* buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errnoError("pread");
+        }
+        if (n == 0) {
+            return Result::Error("pread: unexpected end of segment");
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return Result::OK();
+}
+
+static Result pwriteFull(int fd, const char* buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errnoError("pwrite");
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return Result::OK();
+}
+
+// Parses the record starting at pos in a segment image. Returns false if the
+// record is incomplete or fails its checksum, which marks a torn tail.
+static bool parseRecord(const std::string& data, size_t pos, uint8_t* type,
+                        std::string* key, uint32_t* valueSize, uint32_t* recordSize) {
+    if (pos + kHeaderSize > data.size()) {
+        return false;
+    }
+    uint32_t sum, keyLen, valueLen;
+    std::memcpy(&sum, data.data() + pos, 4);
+    std::memcpy(&keyLen, data.data() + pos + 4, 4);
+    std::memcpy(&valueLen, data.data() + pos + 8, 4);
+    *type = static_cast<uint8_t>(data[pos + 12]);
+    uint64_t size = kHeaderSize + static_cast<uint64_t>(keyLen) + valueLen;
+    if (pos + size > data.size()) {
+        return false;
+    }
+    if (checksum(data.data() + pos + 4, size - 4) != sum) {
+        return false;
+    }
+    if (*type != kTypePut && *type != kTypeDelete) {
+        return false;
+    }
+    key->assign(data, pos + kHeaderSize, keyLen);
+    *valueSize = valueLen;
+    *recordSize = static_cast<uint32_t>(size);
+    return true;
+}
+
+LogStoreAdapter::~LogStoreAdapter() {
+    close();
+}
+
+Result LogStoreAdapter::parseOptions(const std::map<std::string, std::string>& options) {
+    for (const auto& option : options) {
+        if (option.first == "dir") {
+            dir_ = option.second;
+        } else if (option.first == "fresh") {
+            fresh_ = option.second == "true" || option.second == "1";
+            if (fresh_ && reuse_) {
+                return Result::Error("logstore fresh=true would delete the dataset to reuse");
+            }
+        } else if (option.first == "sync") {
+            if (option.second == "none") {
+                syncPolicy_ = SyncPolicy::None;
+            } else if (option.second == "periodic") {
+                syncPolicy_ = SyncPolicy::Periodic;
+            } else if (option.second == "write") {
+                syncPolicy_ = SyncPolicy::Write;
+            } else if (option.second == "group") {
+                syncPolicy_ = SyncPolicy::Group;
+            } else {
+                return Result::Error("Unknown logstore sync policy: " + option.second);
+            }
+        } else if (option.first == "sync_interval_ms") {
+            syncIntervalMs_ = std::stoull(option.second);
+        } else if (option.first == "segment_size") {
+            segmentSize_ = std::stoull(option.second);
+        } else if (option.first == "compaction_threshold") {
+            compactionThreshold_ = std::stod(option.second);
+        } else if (option.first == "compaction_interval_ms") {
+            compactionIntervalMs_ = std::stoull(option.second);
+        } else {
+            return Result::Error("Unknown logstore option: " + option.first);
+        }
+    }
+    if (segmentSize_ == 0) {
+        return Result::Error("logstore segment_size must be positive");
+    }
+    return Result::OK();
+}
+
+Result LogStoreAdapter::init(std::map<std::string, std::string> options) {
+    auto r = parseOptions(options);
+    if (!r.ok()) {
+        return r;
+    }
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        return Result::Error("Cannot create logstore directory " + dir_ + ": " + ec.message());
+    }
+    if (fresh_) {
+        r = removeSegments();
+        if (!r.ok()) {
+            return r;
+        }
+    }
+
+    r = recover();
+    if (!r.ok()) {
+        return r;
+    }
+
+    if (syncPolicy_ == SyncPolicy::Periodic) {
+        syncThread_ = std::thread(&LogStoreAdapter::syncLoop, this);
+    }
+    compactionThread_ = std::thread(&LogStoreAdapter::compactionLoop, this);
+    return Result::OK();
+}
+
+std::string LogStoreAdapter::segmentPath(uint64_t id) const {
+    char name[32];
+    snprintf(name, sizeof(name), "segment-%06llu.log", static_cast<unsigned long long>(id));
+    return dir_ + "/" + name;
+}
+
+Result LogStoreAdapter::openSegment(uint64_t id, Segment** segment) {
+    std::string path = segmentPath(id);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return errnoError("open " + path);
+    }
+    auto seg = std::make_unique<Segment>();
+    seg->id = id;
+    seg->fd = fd;
+    seg->size = 0;
+    seg->liveBytes = 0;
+    *segment = seg.get();
+    segments_[id] = std::move(seg);
+    nextSegmentId_ = std::max(nextSegmentId_, id + 1);
+    return Result::OK();
+}
+
+// Parses the id of a segment file name, rejecting any other file.
+static bool parseSegmentName(const std::string& name, uint64_t* id) {
+    unsigned long long parsed;
+    char canonical[32];
+    if (sscanf(name.c_str(), "segment-%llu.log", &parsed) != 1) {
+        return false;
+    }
+    snprintf(canonical, sizeof(canonical), "segment-%06llu.log", parsed);
+    *id = parsed;
+    return name == canonical;
+}
+
+// Deletes the segments left in dir_ by a previous run. Only the store's own
+// files go: dir_ may be a directory that holds other files too.
+Result LogStoreAdapter::removeSegments() {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        uint64_t id;
+        if (entry.is_regular_file() && parseSegmentName(entry.path().filename().string(), &id) &&
+            unlink(entry.path().c_str()) != 0 && errno != ENOENT) {
+            return errnoError("unlink " + entry.path().string());
+        }
+    }
+    if (ec) {
+        return Result::Error("Cannot list logstore directory " + dir_ + ": " + ec.message());
+    }
+    return Result::OK();
+}
+
+// Rebuilds the index from the segments left in dir_ by a previous run, then
+// starts a new active segment so that recovered segments are never appended to.
+Result LogStoreAdapter::recover() {
+    std::vector<uint64_t> ids;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        uint64_t id;
+        if (parseSegmentName(entry.path().filename().string(), &id)) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint64_t id : ids) {
+        Segment* segment;
+        auto r = openSegment(id, &segment);
+        if (!r.ok()) {
+            return r;
+        }
+        r = replaySegment(segment);
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    return rollSegmentLocked();
+}
+
+Result LogStoreAdapter::replaySegment(Segment* segment) {
+    off_t fileSize = lseek(segment->fd, 0, SEEK_END);
+    if (fileSize < 0) {
+        return errnoError("lseek " + segmentPath(segment->id));
+    }
+    std::string data(fileSize, '\0');
+    auto r = preadFull(segment->fd, &data[0], data.size(), 0);
+    if (!r.ok()) {
+        return r;
+    }
+
+    size_t pos = 0;
+    uint8_t type;
+    std::string key;
+    uint32_t valueSize, recordSize;
+    while (parseRecord(data, pos, &type, &key, &valueSize, &recordSize)) {
+        segment->size = pos + recordSize;
+        applyLocked(key, type == kTypeDelete, Location{segment->id, pos, valueSize, recordSize});
+        pos += recordSize;
+    }
+    // Drop a torn tail left by a crash in the middle of an append.
+    if (pos < data.size() && ftruncate(segment->fd, pos) != 0) {
+        return errnoError("ftruncate " + segmentPath(segment->id));
+    }
+    return Result::OK();
+}
+
+Result LogStoreAdapter::rollSegmentLocked() {
+    if (active_ != nullptr && syncPolicy_ != SyncPolicy::None) {
+        // Everything in a sealed segment is durable, so group commit and
+        // periodic sync only ever need to look at the active segment.
+        syncFd(active_->fd);
+    }
+    return openSegment(nextSegmentId_, &active_);
+}
+
+void LogStoreAdapter::applyLocked(const std::string& key, bool tombstone, const Location& loc) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        auto seg = segments_.find(it->second.segment);
+        if (seg != segments_.end()) {
+            seg->second->liveBytes -= it->second.recordSize;
+        }
+    }
+    if (tombstone) {
+        if (it != index_.end()) {
+            index_.erase(it);
+        }
+        return;
+    }
+    if (it != index_.end()) {
+        it->second = loc;
+    } else {
+        index_.emplace(key, loc);
+    }
+    segments_[loc.segment]->liveBytes += loc.recordSize;
+}
+
+Result LogStoreAdapter::appendLocked(const std::string& key, const std::string* value, uint64_t* seq) {
+    uint32_t valueLen = value ? static_cast<uint32_t>(value->size()) : 0;
+    uint32_t keyLen = static_cast<uint32_t>(key.size());
+    uint32_t recordSize = static_cast<uint32_t>(kHeaderSize + keyLen + valueLen);
+
+    if (active_->size > 0 && active_->size + recordSize > segmentSize_) {
+        auto r = rollSegmentLocked();
+        if (!r.ok()) {
+            return r;
+        }
+    }
+
+    std::string record(recordSize, '\0');
+    uint8_t type = value ? kTypePut : kTypeDelete;
+    std::memcpy(&record[4], &keyLen, 4);
+    std::memcpy(&record[8], &valueLen, 4);
+    record[12] = static_cast<char>(type);
+    std::memcpy(&record[kHeaderSize], key.data(), keyLen);
+    if (value) {
+        std::memcpy(&record[kHeaderSize + keyLen], value->data(), valueLen);
+    }
+    uint32_t sum = checksum(record.data() + 4, recordSize - 4);
+    std::memcpy(&record[0], &sum, 4);
+
+    uint64_t offset = active_->size;
+    auto r = pwriteFull(active_->fd, record.data(), record.size(), offset);
+    if (!r.ok()) {
+        return r;
+    }
+    active_->size += recordSize;
+    bytesAppended_ += recordSize;
+    applyLocked(key, value == nullptr, Location{active_->id, offset, valueLen, recordSize});
+
+    if (syncPolicy_ == SyncPolicy::Write) {
+        syncFd(active_->fd);
+    }
+    *seq = ++writeSeq_;
+    return Result::OK();
+}
+
+void LogStoreAdapter::syncFd(int fd) {
+    TraceSpan span("fdatasync");
+    uint64_t start = nowMicros();
+    fdatasync(fd);
+    syncMicros_ += nowMicros() - start;
+    syncs_++;
+}
+
+// Group commit: the first writer to find no sync in flight becomes the leader
+// and issues one fdatasync covering every record appended so far; writers that
+// arrive meanwhile wait for it, or for the next one if theirs came too late.
+void LogStoreAdapter::waitDurable(uint64_t seq) {
+    if (syncPolicy_ != SyncPolicy::Group) {
+        return;
+    }
+    TraceSpan span("group_commit");
+    std::unique_lock<std::mutex> lock(syncMutex_);
+    while (syncedSeq_ < seq) {
+        if (syncInProgress_) {
+            syncCv_.wait(lock);
+            continue;
+        }
+        syncInProgress_ = true;
+        lock.unlock();
+
+        uint64_t target;
+        {
+            std::shared_lock<std::shared_mutex> indexLock(mutex_);
+            target = writeSeq_;
+            syncFd(active_->fd);
+        }
+
+        lock.lock();
+        syncedSeq_ = std::max(syncedSeq_, target);
+        syncInProgress_ = false;
+        syncCv_.notify_all();
+    }
+}
+
+Result LogStoreAdapter::put(const std::string& key, const std::string& value) {
+    uint64_t seq;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_, std::defer_lock);
+        {
+            TraceSpan span("lock_wait");
+            lock.lock();
+        }
+        TraceSpan span("append");
+        auto r = appendLocked(key, &value, &seq);
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    waitDurable(seq);
+    return Result::OK();
+}
+
+Result LogStoreAdapter::remove(const std::string& key) {
+    uint64_t seq;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (index_.find(key) == index_.end()) {
+            return Result::NotFound();
+        }
+        auto r = appendLocked(key, nullptr, &seq);
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    waitDurable(seq);
+    return Result::OK();
+}
+
+Result LogStoreAdapter::readValueLocked(const std::string& key, const Location& loc, std::string* value) const {
+    auto seg = segments_.find(loc.segment);
+    if (seg == segments_.end()) {
+        return Result::Error("logstore index points to a missing segment");
+    }
+    value->resize(loc.valueSize);
+    if (loc.valueSize == 0) {
+        return Result::OK();
+    }
+    TraceSpan span("pread");
+    return preadFull(seg->second->fd, &(*value)[0], loc.valueSize, loc.offset + kHeaderSize + key.size());
+}
+
+Result LogStoreAdapter::get(const std::string& key) {
+    std::string value;
+    return getValue(key, &value);
+}
+
+Result LogStoreAdapter::getValue(const std::string& key, std::string* value) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return Result::NotFound();
+    }
+    return readValueLocked(key, it->second, value);
+}
+
+// Reads every live record in [start, end).
+Result LogStoreAdapter::scan(const std::string& start, const std::string& end) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::string value;
+    bool found = false;
+    for (auto it = index_.lower_bound(start); it != index_.end() && it->first < end; ++it) {
+        auto r = readValueLocked(it->first, it->second, &value);
+        if (!r.ok()) {
+            return r;
+        }
+        found = true;
+    }
+    // an empty range counts as a miss, as a get of a missing key does
+    return found ? Result::OK() : Result::NotFound();
+}
+
+void LogStoreAdapter::syncLoop() {
+    std::unique_lock<std::mutex> lock(bgMutex_);
+    while (!stop_) {
+        bgCv_.wait_for(lock, std::chrono::milliseconds(syncIntervalMs_));
+        if (stop_) {
+            break;
+        }
+        std::shared_lock<std::shared_mutex> indexLock(mutex_);
+        syncFd(active_->fd);
+    }
+}
+
+void LogStoreAdapter::compactionLoop() {
+    std::unique_lock<std::mutex> lock(bgMutex_);
+    while (!stop_) {
+        bgCv_.wait_for(lock, std::chrono::milliseconds(compactionIntervalMs_));
+        if (stop_) {
+            break;
+        }
+
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> compactLock(compactMutex_);
+            uint64_t victim;
+            if (pickVictim(&victim)) {
+                compactSegment(victim);
+            }
+        }
+        lock.lock();
+    }
+}
+
+// Picks the sealed segment with the lowest live ratio under the threshold.
+bool LogStoreAdapter::pickVictim(uint64_t* victim) {
+    std::shared_lock<std::shared_mutex> indexLock(mutex_);
+    double best = compactionThreshold_;
+    bool found = false;
+    for (const auto& entry : segments_) {
+        const Segment& seg = *entry.second;
+        if (&seg == active_ || seg.size == 0) {
+            continue;
+        }
+        double live = static_cast<double>(seg.liveBytes) / seg.size;
+        if (live < best) {
+            best = live;
+            *victim = seg.id;
+            found = true;
+        }
+    }
+    return found;
+}
+
+Result LogStoreAdapter::reuseData() {
+    reuse_ = true;
+    fresh_ = false;
+    return Result::OK();
+}
+
+bool LogStoreAdapter::startedFresh() const {
+    return fresh_;
+}
+
+std::string LogStoreAdapter::dataDirectory() const {
+    return dir_;
+}
+
+// Runs every compaction that is due now rather than one per interval, then
+// makes the active segment durable.
+Result LogStoreAdapter::quiesce() {
+    {
+        std::lock_guard<std::mutex> compactLock(compactMutex_);
+        std::set<uint64_t> tried;   // a segment that failed to compact stays put
+        uint64_t victim;
+        while (!stop_ && pickVictim(&victim) && tried.insert(victim).second) {
+            compactSegment(victim);
+        }
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    syncFd(active_->fd);
+    return Result::OK();
+}
+
+// Moves the live records of a sealed segment to the active segment and
+// deletes it. Records are copied one at a time so that foreground writers
+// are only held up for a single append.
+void LogStoreAdapter::compactSegment(uint64_t id) {
+    TraceSpan span("compact_segment");
+    int fd;
+    uint64_t size;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const Segment& seg = *segments_.at(id);
+        fd = seg.fd;
+        size = seg.size;
+    }
+    std::string data(size, '\0');
+    if (!preadFull(fd, &data[0], size, 0).ok()) {
+        return;
+    }
+
+    size_t pos = 0;
+    uint8_t type;
+    std::string key;
+    uint32_t valueSize, recordSize;
+    uint64_t seq;
+    while (!stop_ && parseRecord(data, pos, &type, &key, &valueSize, &recordSize)) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (type == kTypePut) {
+            if (it != index_.end() && it->second.segment == id && it->second.offset == pos) {
+                std::string value(data, pos + kHeaderSize + key.size(), valueSize);
+                if (appendLocked(key, &value, &seq).ok()) {
+                    bytesCompacted_ += recordSize;
+                }
+            }
+        } else if (it == index_.end() && segments_.begin()->first < id) {
+            // An older segment may still hold a put this tombstone shadows.
+            if (appendLocked(key, nullptr, &seq).ok()) {
+                bytesCompacted_ += recordSize;
+            }
+        }
+        pos += recordSize;
+    }
+    if (stop_) {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (syncPolicy_ != SyncPolicy::None) {
+        syncFd(active_->fd);
+    }
+    ::close(fd);
+    unlink(segmentPath(id).c_str());
+    segments_.erase(id);
+    segmentsCompacted_++;
+}
+
+void LogStoreAdapter::close() {
+    {
+        std::lock_guard<std::mutex> lock(bgMutex_);
+        stop_ = true;
+    }
+    bgCv_.notify_all();
+    if (syncThread_.joinable()) {
+        syncThread_.join();
+    }
+    if (compactionThread_.joinable()) {
+        compactionThread_.join();
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (active_ == nullptr) {
+        return;
+    }
+    if (syncPolicy_ != SyncPolicy::None) {
+        syncFd(active_->fd);
+    }
+    for (const auto& entry : segments_) {
+        ::close(entry.second->fd);
+    }
+
+    uint64_t syncs = syncs_;
+    printf("==== logstore ====\n");
+    printf("Appended    : %llu bytes\n", static_cast<unsigned long long>(bytesAppended_.load()));
+    printf("Compacted   : %llu bytes from %llu segments\n",
+           static_cast<unsigned long long>(bytesCompacted_.load()),
+           static_cast<unsigned long long>(segmentsCompacted_.load()));
+    printf("Syncs       : %llu (avg %.1f µs)\n", static_cast<unsigned long long>(syncs),
+           syncs > 0 ? static_cast<double>(syncMicros_) / syncs : 0.0);
+    printf("Live keys   : %zu\n", index_.size());
+
+    segments_.clear();
+    active_ = nullptr;
+}
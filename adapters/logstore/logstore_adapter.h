@@ -0,0 +1,125 @@
+#ifndef LOGSTORE_ADAPTER_H
+#define LOGSTORE_ADAPTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include "kvstore.h"
+#include "result.h"
+
+// How appended records are made durable.
+enum class SyncPolicy {
+    None,      // never sync, rely on the page cache
+    Periodic,  // a background thread fdatasyncs every sync_interval_ms
+    Write,     // fdatasync after every single write
+    Group      // writers wait for a shared fdatasync issued by a leader
+};
+
+// LogStoreAdapter is a small log-structured reference store. Records are
+// appended to segment files on local disk, an ordered in-memory index maps
+// every live key to its latest record, and a background thread compacts
+// sealed segments once most of their records are dead.
+class LogStoreAdapter : public KVStore {
+public:
+    LogStoreAdapter() = default;
+    ~LogStoreAdapter() override;
+
+    Result init(std::map<std::string, std::string> options) override;
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+    Result reuseData() override;
+    bool startedFresh() const override;
+    std::string dataDirectory() const override;
+    Result quiesce() override;
+
+private:
+    // Location of the latest record of a key.
+    struct Location {
+        uint64_t segment;
+        uint64_t offset;   // offset of the record header
+        uint32_t valueSize;
+        uint32_t recordSize;
+    };
+
+    struct Segment {
+        uint64_t id;
+        int fd;
+        uint64_t size;       // bytes appended so far
+        uint64_t liveBytes;  // bytes still referenced by the index
+    };
+
+    // Options
+    std::string dir_ = "./logstore_data";
+    bool fresh_ = true;  // delete the segments in dir_ on init instead of recovering them
+    bool reuse_ = false; // the harness reuses the dataset, so fresh_ must stay off
+    SyncPolicy syncPolicy_ = SyncPolicy::None;
+    uint64_t syncIntervalMs_ = 1000;
+    uint64_t segmentSize_ = 64 * 1048576;
+    double compactionThreshold_ = 0.5;  // compact when live/size drops below this
+    uint64_t compactionIntervalMs_ = 100;
+
+    // Index and segments, guarded by mutex_.
+    std::shared_mutex mutex_;
+    std::map<std::string, Location> index_;
+    std::map<uint64_t, std::unique_ptr<Segment>> segments_;
+    Segment* active_ = nullptr;
+    uint64_t nextSegmentId_ = 0;
+
+    uint64_t writeSeq_ = 0;  // sequence of the last appended record
+
+    // Group commit state, guarded by syncMutex_.
+    std::mutex syncMutex_;
+    std::condition_variable syncCv_;
+    bool syncInProgress_ = false;
+    uint64_t syncedSeq_ = 0;  // sequence covered by the last completed sync
+
+    // Background threads.
+    std::atomic<bool> stop_{false};
+    std::mutex bgMutex_;
+    std::condition_variable bgCv_;
+    std::thread syncThread_;
+    std::thread compactionThread_;
+    std::mutex compactMutex_;   // one compaction at a time, background or quiesce()
+
+    // Counters reported when the store is closed.
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> syncMicros_{0};
+    std::atomic<uint64_t> bytesAppended_{0};
+    std::atomic<uint64_t> bytesCompacted_{0};
+    std::atomic<uint64_t> segmentsCompacted_{0};
+
+    Result parseOptions(const std::map<std::string, std::string>& options);
+    Result removeSegments();
+    Result recover();
+    Result replaySegment(Segment* segment);
+    Result openSegment(uint64_t id, Segment** segment);
+    std::string segmentPath(uint64_t id) const;
+
+    // Appends a record while holding mutex_ exclusively. A null value writes a
+    // tombstone. On success, seq holds the sequence number the caller must
+    // wait on (see waitDurable) before acknowledging the write.
+    Result appendLocked(const std::string& key, const std::string* value, uint64_t* seq);
+    // Points the index at a freshly appended or replayed record.
+    void applyLocked(const std::string& key, bool tombstone, const Location& loc);
+    Result readValueLocked(const std::string& key, const Location& loc, std::string* value) const;
+    Result rollSegmentLocked();
+    void waitDurable(uint64_t seq);
+    void syncFd(int fd);
+
+    void syncLoop();
+    void compactionLoop();
+    bool pickVictim(uint64_t* victim);
+    void compactSegment(uint64_t id);
+    void close();
+};
+
+#endif // LOGSTORE_ADAPTER_H
@@ -0,0 +1,10 @@
+#include "logstore_adapter.h"
+#include "kvstore_factory.h"
+#include <memory>
+
+extern "C" void registerAdapters(KVStoreFactory& factory) {
+    factory.registerAdapter(
+        "logstore", [](){
+        return std::make_unique<LogStoreAdapter>();
+    });
+}
@@ -0,0 +1,10 @@
+#include "shard_adapter.h"
+#include "kvstore_factory.h"
+#include <memory>
+
+extern "C" void registerAdapters(KVStoreFactory& factory) {
+    factory.registerAdapter(
+        "shard", [](){
+        return std::make_unique<ShardAdapter>();
+    });
+}
@@ -0,0 +1,348 @@
+#include "shard_adapter.h"
+#include "kvstore_factory.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+// Serializes the ops of one shard of a backend that is not thread-safe.
+class LockedSession : public KVSession {
+public:
+    LockedSession(KVSession* target, std::mutex* mutex) : target_(target), mutex_(mutex) {}
+
+    Result put(const std::string& key, const std::string& value) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->put(key, value);
+    }
+    Result get(const std::string& key) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->get(key);
+    }
+    Result getValue(const std::string& key, std::string* value) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->getValue(key, value);
+    }
+    Result remove(const std::string& key) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->remove(key);
+    }
+    Result scan(const std::string& start, const std::string& end) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->scan(start, end);
+    }
+
+private:
+    KVSession* target_;
+    std::mutex* mutex_;
+};
+
+ShardSession::ShardSession(const ShardAdapter* router, std::vector<std::unique_ptr<KVSession>> owned,
+                           std::vector<KVSession*> targets)
+    : router_(router), owned_(std::move(owned)), targets_(std::move(targets)) {}
+
+Result ShardSession::put(const std::string& key, const std::string& value) {
+    return targets_[router_->shardOf(key)]->put(key, value);
+}
+
+Result ShardSession::get(const std::string& key) {
+    return targets_[router_->shardOf(key)]->get(key);
+}
+
+Result ShardSession::getValue(const std::string& key, std::string* value) {
+    return targets_[router_->shardOf(key)]->getValue(key, value);
+}
+
+Result ShardSession::remove(const std::string& key) {
+    return targets_[router_->shardOf(key)]->remove(key);
+}
+
+Result ShardSession::scan(const std::string& start, const std::string& end) {
+    size_t first, last;
+    router_->shardsOf(start, end, &first, &last);
+    bool found = false;
+    for (size_t i = first; i <= last; i++) {
+        Result r = targets_[i]->scan(start, end);
+        if (r.ok()) {
+            found = true;
+        } else if (!r.isNotFound()) {
+            return r;
+        }
+    }
+    return found ? Result::OK() : Result::NotFound();
+}
+
+// FNV-1a, so that keys land on the same shard in every run and on every
+// platform, as reusing a dataset requires.
+static uint64_t hashKey(const std::string& key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+size_t ShardAdapter::shardOf(const std::string& key) const {
+    if (rangeRouting_) {
+        return std::upper_bound(splitKeys_.begin(), splitKeys_.end(), key) - splitKeys_.begin();
+    }
+    return hashKey(key) % numShards_;
+}
+
+void ShardAdapter::shardsOf(const std::string& start, const std::string& end, size_t* first, size_t* last) const {
+    if (rangeRouting_) {
+        *first = shardOf(start);
+        *last = std::max(*first, static_cast<size_t>(std::lower_bound(splitKeys_.begin(), splitKeys_.end(), end) -
+                                                     splitKeys_.begin()));
+    } else {
+        *first = 0;
+        *last = numShards_ - 1;
+    }
+}
+
+// Splits the options into the shard adapter's own and those of every shard.
+Result ShardAdapter::parseOptions(const std::map<std::string, std::string>& options,
+                                  std::vector<std::map<std::string, std::string>>* shardOptions) {
+    std::map<std::string, std::string> common;
+    std::map<std::string, std::string> perShard;
+    for (const auto& option : options) {
+        if (option.first == "backend") {
+            backend_ = option.second;
+        } else if (option.first == "shards") {
+            numShards_ = std::stoul(option.second);
+        } else if (option.first == "routing") {
+            if (option.second != "hash" && option.second != "range") {
+                return Result::Error("Unknown shard routing: " + option.second);
+            }
+            rangeRouting_ = option.second == "range";
+        } else if (option.first == "split_keys") {
+            std::stringstream keys(option.second);
+            std::string key;
+            splitKeys_.clear();
+            while (std::getline(keys, key, ',')) {
+                splitKeys_.push_back(key);
+            }
+        } else if (option.first == "dir_option") {
+            dirOption_ = option.second;
+        } else if (!option.first.empty() && isdigit(static_cast<unsigned char>(option.first[0]))) {
+            perShard.insert(option);
+        } else {
+            common.insert(option);
+        }
+    }
+    if (backend_.empty()) {
+        return Result::Error("shard needs --shard-backend=<adapter>");
+    }
+    if (backend_ == "shard") {
+        return Result::Error("shard cannot be its own backend");
+    }
+    if (numShards_ == 0) {
+        return Result::Error("shard needs at least one shard");
+    }
+    if (rangeRouting_ && (splitKeys_.size() != numShards_ - 1 ||
+                          !std::is_sorted(splitKeys_.begin(), splitKeys_.end()))) {
+        return Result::Error("Range routing needs " + std::to_string(numShards_ - 1) + " ascending split_keys");
+    }
+
+    common = forwardedOptions(backend_, common);
+    auto dir = common.find(dirOption_);
+    if (dir != common.end()) {
+        dir_ = dir->second;
+    }
+    shardOptions->assign(numShards_, common);
+    for (size_t i = 0; i < numShards_; i++) {
+        if (!dir_.empty()) {
+            (*shardOptions)[i][dirOption_] = dir_ + "/shard-" + std::to_string(i);
+        }
+    }
+    std::vector<std::map<std::string, std::string>> ownOptions(numShards_);
+    for (const auto& option : perShard) {
+        size_t dot = option.first.find('.');
+        if (dot == std::string::npos || std::stoul(option.first.substr(0, dot)) >= numShards_) {
+            return Result::Error("Invalid per-shard option: " + option.first);
+        }
+        ownOptions[std::stoul(option.first.substr(0, dot))][option.first.substr(dot + 1)] = option.second;
+    }
+    for (size_t i = 0; i < numShards_; i++) {
+        for (const auto& option : forwardedOptions(backend_, ownOptions[i])) {
+            (*shardOptions)[i][option.first] = option.second;
+        }
+    }
+    return Result::OK();
+}
+
+Result ShardAdapter::init(std::map<std::string, std::string> options) {
+    std::vector<std::map<std::string, std::string>> shardOptions;
+    Result r = Result::OK();
+    try {
+        r = parseOptions(options, &shardOptions);
+    } catch (const std::exception&) {
+        return Result::Error("Invalid shard option");
+    }
+    if (!r.ok()) {
+        return r;
+    }
+
+    // the factory loads the backend's plugin on first use
+    KVStoreFactory& factory = KVStoreFactory::instance();
+    for (size_t i = 0; i < numShards_; i++) {
+        try {
+            shards_.push_back(factory.create(backend_));
+        } catch (const std::exception& e) {
+            return Result::Error(e.what());
+        }
+    }
+    // without a directory option, the shards would all share the backend's
+    // default directory; give each its own under it instead
+    if (dir_.empty()) {
+        std::map<std::string, std::string> firstOptions = shardOptions[0];
+        firstOptions.erase(dirOption_);
+        dir_ = shards_[0]->defaultDataDirectory(firstOptions);
+    }
+    for (size_t i = 0; i < numShards_; i++) {
+        if (!dir_.empty() && shardOptions[i].count(dirOption_) == 0) {
+            shardOptions[i][dirOption_] = dir_ + "/shard-" + std::to_string(i);
+        }
+        if (reuse_) {
+            r = shards_[i]->reuseData();
+            if (!r.ok()) {
+                return r;
+            }
+        }
+        r = shards_[i]->init(shardOptions[i]);
+        if (!r.ok()) {
+            return Result::Error("shard " + std::to_string(i) + ": " + r.message());
+        }
+    }
+
+    backendSafety_ = shards_[0]->threadSafety();
+    if (backendSafety_ != ThreadSafety::PerThread) {
+        std::vector<std::unique_ptr<KVSession>> owned;
+        std::vector<KVSession*> targets;
+        for (auto& shard : shards_) {
+            if (backendSafety_ == ThreadSafety::Serialized) {
+                locks_.push_back(std::make_unique<std::mutex>());
+                owned.push_back(std::make_unique<LockedSession>(shard.get(), locks_.back().get()));
+                targets.push_back(owned.back().get());
+            } else {
+                targets.push_back(shard.get());
+            }
+        }
+        shared_ = std::make_unique<ShardSession>(this, std::move(owned), std::move(targets));
+    }
+    return Result::OK();
+}
+
+ThreadSafety ShardAdapter::threadSafety() const {
+    return backendSafety_ == ThreadSafety::PerThread ? ThreadSafety::PerThread : ThreadSafety::Shared;
+}
+
+// Opens a session on every shard for the calling thread.
+Result ShardAdapter::openSession(std::unique_ptr<KVSession>& session) {
+    std::vector<std::unique_ptr<KVSession>> owned;
+    std::vector<KVSession*> targets;
+    for (auto& shard : shards_) {
+        std::unique_ptr<KVSession> shardSession;
+        Result r = shard->openSession(shardSession);
+        if (!r.ok()) {
+            return r;
+        }
+        targets.push_back(shardSession.get());
+        owned.push_back(std::move(shardSession));
+    }
+    session = std::make_unique<ShardSession>(this, std::move(owned), std::move(targets));
+    return Result::OK();
+}
+
+Result ShardAdapter::put(const std::string& key, const std::string& value) {
+    return shared_->put(key, value);
+}
+
+Result ShardAdapter::get(const std::string& key) {
+    return shared_->get(key);
+}
+
+Result ShardAdapter::getValue(const std::string& key, std::string* value) {
+    return shared_->getValue(key, value);
+}
+
+Result ShardAdapter::remove(const std::string& key) {
+    return shared_->remove(key);
+}
+
+Result ShardAdapter::scan(const std::string& start, const std::string& end) {
+    return shared_->scan(start, end);
+}
+
+Result ShardAdapter::reuseData() {
+    reuse_ = true;
+    return Result::OK();
+}
+
+bool ShardAdapter::startedFresh() const {
+    for (const auto& shard : shards_) {
+        if (shard->startedFresh()) {
+            return true;
+        }
+    }
+    return shards_.empty();
+}
+
+std::string ShardAdapter::dataDirectory() const {
+    if (!dir_.empty()) {
+        return dir_;
+    }
+    return shards_.empty() ? "" : shards_[0]->dataDirectory();
+}
+
+// The parent of the shard directories init would pick: the backend's
+// directory option, else the backend's default directory.
+std::string ShardAdapter::defaultDataDirectory(const std::map<std::string, std::string>& options) const {
+    auto backend = options.find("backend");
+    if (backend == options.end() || backend->second == "shard") {
+        return "";
+    }
+    auto dirOption = options.find("dir_option");
+    std::string dirKey = dirOption != options.end() ? dirOption->second : dirOption_;
+    std::map<std::string, std::string> common;
+    for (const auto& option : options) {
+        if (option.first != "backend" && option.first != "shards" && option.first != "routing" &&
+            option.first != "split_keys" && option.first != "dir_option" && !option.first.empty() &&
+            !isdigit(static_cast<unsigned char>(option.first[0]))) {
+            common.insert(option);
+        }
+    }
+    common = forwardedOptions(backend->second, common);
+    auto dir = common.find(dirKey);
+    if (dir != common.end()) {
+        return dir->second;
+    }
+    try {
+        return KVStoreFactory::instance().create(backend->second)->defaultDataDirectory(common);
+    } catch (const std::exception&) {
+        return "";
+    }
+}
+
+// The reports of the shards, one after the other.
+std::string ShardAdapter::takeStepReport() {
+    std::string out;
+    for (size_t i = 0; i < shards_.size(); i++) {
+        std::string report = shards_[i]->takeStepReport();
+        if (!report.empty()) {
+            out += "Shard " + std::to_string(i) + ":\n" + report;
+        }
+    }
+    return out;
+}
+
+Result ShardAdapter::quiesce() {
+    for (auto& shard : shards_) {
+        Result r = shard->quiesce();
+        if (!r.ok()) {
+            return r;
+        }
+    }
+    return Result::OK();
+}
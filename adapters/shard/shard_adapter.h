@@ -0,0 +1,99 @@
+#ifndef SHARD_ADAPTER_H
+#define SHARD_ADAPTER_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "kvstore.h"
+#include "result.h"
+
+class ShardAdapter;
+
+// ShardSession routes every op to the shard that owns its key, through one
+// target per shard: the shards themselves, per-thread sessions on them, or
+// locked wrappers around shards that are not thread-safe.
+class ShardSession : public KVSession {
+public:
+    ShardSession(const ShardAdapter* router, std::vector<std::unique_ptr<KVSession>> owned,
+                 std::vector<KVSession*> targets);
+
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    // Scans every shard that may hold keys of [start, end) and merges their
+    // results: an error from any shard fails the scan, and it finds keys if
+    // any shard did.
+    Result scan(const std::string& start, const std::string& end) override;
+
+private:
+    const ShardAdapter* router_;
+    std::vector<std::unique_ptr<KVSession>> owned_;
+    std::vector<KVSession*> targets_;
+};
+
+// ShardAdapter partitions the keyspace over N instances of another adapter,
+// created through KVStoreFactory, to compare instance-per-core sharding with
+// a single shared instance.
+//
+// Options (--shard-<option>=<value>):
+//   backend      the adapter of every shard (required)
+//   shards       number of instances, 4 by default
+//   routing      hash (default) or range
+//   split_keys   range routing: the N-1 ascending keys where shards begin
+//   dir_option   backend option holding its data directory, "dir" by default;
+//                each shard gets <dir>/shard-<i> unless <i>.<dir_option> is set,
+//                under the backend's default directory if no dir is given
+//   <i>.<option> passed to shard i only
+// Any other option is passed to every shard. Options passed on lose their
+// "<backend>-" prefix if they have one (see forwardedOptions).
+//
+// A backend that is not thread-safe gets a lock per shard, so that threads
+// working on different shards do not wait for each other.
+class ShardAdapter : public KVStore {
+public:
+    ShardAdapter() = default;
+    ~ShardAdapter() override = default;
+
+    Result init(std::map<std::string, std::string> options) override;
+    Result put(const std::string& key, const std::string& value) override;
+    Result get(const std::string& key) override;
+    Result getValue(const std::string& key, std::string* value) override;
+    Result remove(const std::string& key) override;
+    Result scan(const std::string& start, const std::string& end) override;
+
+    ThreadSafety threadSafety() const override;
+    Result openSession(std::unique_ptr<KVSession>& session) override;
+    Result reuseData() override;
+    bool startedFresh() const override;
+    std::string dataDirectory() const override;
+    std::string defaultDataDirectory(const std::map<std::string, std::string>& options) const override;
+    Result quiesce() override;
+    std::string takeStepReport() override;
+
+    // The shard owning key.
+    size_t shardOf(const std::string& key) const;
+    // The shards that may hold keys of [start, end).
+    void shardsOf(const std::string& start, const std::string& end, size_t* first, size_t* last) const;
+
+private:
+    std::string backend_;
+    size_t numShards_ = 4;
+    bool rangeRouting_ = false;
+    std::vector<std::string> splitKeys_;
+    std::string dirOption_ = "dir";
+    std::string dir_;          // the backend data directory option, parent of the shard directories
+    bool reuse_ = false;       // open the shards' data from a previous run
+
+    ThreadSafety backendSafety_ = ThreadSafety::Shared;
+    std::vector<std::unique_ptr<KVStore>> shards_;
+    std::vector<std::unique_ptr<std::mutex>> locks_;   // one per shard, for Serialized backends
+    std::unique_ptr<ShardSession> shared_;             // routes ops unless the backend needs sessions
+
+    Result parseOptions(const std::map<std::string, std::string>& options,
+                        std::vector<std::map<std::string, std::string>>* shardOptions);
+};
+
+#endif // SHARD_ADAPTER_H
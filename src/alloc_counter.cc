@@ -0,0 +1,74 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstddef>
+
+static std::atomic<bool> enabled_{false};
+
+// Plain zero-initialized thread locals: touching them from inside malloc must
+// never allocate.
+static thread_local AllocScope scope_ = AllocScope::Harness;
+static thread_local AllocCounts counts_[2];
+
+#ifdef MARCCSMAN_ALLOC_COUNTER
+
+static inline void count(size_t size) {
+    if (enabled_.load(std::memory_order_relaxed)) {
+        AllocCounts &c = counts_[static_cast<int>(scope_)];
+        c.allocs++;
+        c.bytes += size;
+    }
+}
+
+// glibc's own entry points, which the definitions below forward to. Defining
+// malloc and friends in the executable interposes them for the harness and
+// every adapter plugin alike.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+bool AllocCounter::available() { return true; }
+
+#else
+
+bool AllocCounter::available() { return false; }
+
+#endif // MARCCSMAN_ALLOC_COUNTER
+
+void AllocCounter::enable(bool on) {
+    enabled_.store(on, std::memory_order_relaxed);
+}
+
+bool AllocCounter::enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+void AllocCounter::setScope(AllocScope scope) {
+    scope_ = scope;
+}
+
+void AllocCounter::reset() {
+    counts_[0] = AllocCounts();
+    counts_[1] = AllocCounts();
+}
+
+AllocCounts AllocCounter::counts(AllocScope scope) {
+    return counts_[static_cast<int>(scope)];
+}
@@ -0,0 +1,36 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Who a worker thread is currently allocating for.
+enum class AllocScope {
+    Harness,
+    Adapter
+};
+
+struct AllocCounts {
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+};
+
+//
+// AllocCounter: per-thread heap allocation counters. They are fed by a
+// malloc interposer that is only compiled in with the MARCCSMAN_ALLOC_COUNTER
+// CMake option, so regular builds pay nothing for it.
+//
+class AllocCounter {
+public:
+    // Returns true if the interposer is compiled in.
+    static bool available();
+    // Turns counting on or off for the whole process.
+    static void enable(bool on);
+    static bool enabled();
+
+    // The calling thread's current scope and counters.
+    static void setScope(AllocScope scope);
+    static void reset();
+    static AllocCounts counts(AllocScope scope);
+};
+
+#endif // ALLOC_COUNTER_H
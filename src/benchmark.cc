@@ -1,148 +1,78 @@
+#include <condition_variable>
+#include <sstream>
 #include <thread>
 #include <utility>
 
 #include "benchmark.h"
+#include "noop_kvstore.h"
+#include "trace.h"
+#include "verify.h"
+#include "workload_spec.h"
 #include <random>
 #include <cassert>
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <queue>
 
-// define the benchmark options list
-const std::vector<std::string> supportedWorkloads = {
-	"fillseq",
-	"fillrandom",
-    "ycsba",
-	"ycsbb",
-	"ycsbc",
-	"ycsbd",
-	"ycsbe"
-};
-
-// ----------
-// Distribution Implementation
-// an helper class to generate random values with different distributions
-// ----------
-
-// Base class for a distribution.
-class BaseDistribution {
-public:
-    virtual ~BaseDistribution() = default;
-    virtual unsigned int Generate() = 0;
-};
-
-// Fixed distribution always returns the same value.
-class FixedDistribution : public BaseDistribution {
-public:
-    FixedDistribution(unsigned int value) : value_(value) {}
-    unsigned int Generate() override {
-        return value_;
-    }
-private:
-    unsigned int value_;
-};
-
-// Uniform distribution returns a random value between min and max.
-class UniformDistribution : public BaseDistribution {
-public:
-    UniformDistribution(unsigned int min, unsigned int max)
-        : dist_(min, max) {}
-    unsigned int Generate() override {
-        return dist_(gen_);
-    }
-private:
-    std::mt19937 gen_{ std::random_device{}() };
-    std::uniform_int_distribution<unsigned int> dist_;
-};
-
-// Normal distribution returns a value centered around the average with a given stddev.
-// The result is clamped to the [min, max] range.
-class NormalDistribution : public BaseDistribution {
-public:
-    NormalDistribution(unsigned int min, unsigned int max)
-        : gen_(std::random_device{}()),
-          dist_((min + max) / 2.0, (max - min) / 6.0), // 99.7% of values within [min, max]
-          min_(min), max_(max) {}
-    unsigned int Generate() override {
-        unsigned int val = static_cast<unsigned int>(std::round(dist_(gen_)));
-        return std::max(min_, std::min(max_, val));
-    }
-private:
-    std::mt19937 gen_;
-    std::normal_distribution<double> dist_;
-    unsigned int min_;
-    unsigned int max_;
-};
-
-// ZipfianDistribution generates integers in [min, max] following a Zipfian (power-law) distribution.
-class ZipfianDistribution : public BaseDistribution {
-public:
-    // min: lower bound (inclusive)
-    // max: upper bound (inclusive)
-    // s: exponent parameter (typically > 1)
-    ZipfianDistribution(unsigned int min, unsigned int max, double s = 1.2)
-        : min_(min), max_(max), s_(s), gen_(std::random_device{}()), uniDist_(0.0, 1.0)
-    {
-        // Precompute the cumulative distribution function (CDF)
-        unsigned int N = max_ - min_ + 1;
-        cdf_.resize(N);
-        double sum = 0.0;
-        for (unsigned int i = min_; i <= max_; i++) {
-            sum += 1.0 / std::pow(static_cast<double>(i), s_);
-            cdf_[i - min_] = sum;
-        }
-        // Normalize all values in the CDF so that the last element equals 1.
-        for (double &val : cdf_) {
-            val /= sum;
-        }
-    }
-    
-    // Generate returns a number in [min_, max_] according to the Zipfian distribution.
-    unsigned int Generate() override {
-        double u = uniDist_(gen_);
-        // Binary search for the location in the CDF.
-        auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
-        unsigned int index = it - cdf_.begin();
-        return min_ + index;
-    }
-    
-private:
-    unsigned int min_;
-    unsigned int max_;
-    double s_;
-    std::vector<double> cdf_;
-    std::mt19937 gen_;
-    std::uniform_real_distribution<double> uniDist_;
-};
-
-// in this distribution, the latest values are the most popular
-class LatestDistribution : public BaseDistribution {
-public:
-    // min: the lowest possible key value (for example 0)
-    // max: the highest possible key value (for example, total number of keys - 1)
-    // lambda: controls how steep the decay is (a higher value makes keys even more biased toward the max)
-    LatestDistribution(unsigned int min, unsigned int max, double lambda = 1.0)
-        : min_(min), max_(max), lambda_(lambda), gen_(std::random_device{}()),
-          expDist_(lambda) {}
-
-    unsigned int Generate() override {
-        // Generate an exponential value x. Since exp(x) decays quickly, most x will be small.
-        double x = expDist_(gen_);
-        // Convert it into a number u in (0,1] by using the exponential decay.
-        double u = std::exp(-x);
-        // Now, use u to bias the key toward the high end.
-        // When u is near 1, the key is near max; when u is small, the key is lower.
-        unsigned int key = max_ - static_cast<unsigned int>(u * (max_ - min_));
-        return key;
-    }
-    
-private:
-    unsigned int min_;
-    unsigned int max_;
-    double lambda_;
-    std::mt19937 gen_;
-    std::exponential_distribution<double> expDist_;
-};
+// The built-in workloads, run by the same op loop as the ones read from
+// --workload_file.
+static std::vector<WorkloadSpec> builtinWorkloads() {
+	auto spec = [](const std::string &name, DistributionType keys, bool load,
+	               double read, double update, double insert, double scan) {
+		WorkloadSpec s;
+		s.name = name;
+		s.keyDistribution = keys;
+		s.load = load;
+		s.proportions[static_cast<int>(SpecOp::READ)] = read;
+		s.proportions[static_cast<int>(SpecOp::UPDATE)] = update;
+		s.proportions[static_cast<int>(SpecOp::INSERT)] = insert;
+		s.proportions[static_cast<int>(SpecOp::SCAN)] = scan;
+		return s;
+	};
+	WorkloadSpec ycsbf = spec("ycsbf", DistributionType::Zipfian, false, 0.5, 0, 0, 0);
+	ycsbf.proportions[static_cast<int>(SpecOp::RMW)] = 0.5;
+	WorkloadSpec churn = spec("churn", DistributionType::Latest, false, 0.2, 0, 0.4, 0);
+	churn.proportions[static_cast<int>(SpecOp::DELETE)] = 0.4;
+	churn.deleteOldest = true;
+	WorkloadSpec scanAfterDelete = spec("scanafterdelete", DistributionType::Uniform, false, 0, 0, 0, 1);
+	scanAfterDelete.massDeleteFraction = 0.5;
+	return {
+		// every thread writes num keys, in order or at random
+		spec("fillseq", DistributionType::Sequential, true, 0, 1, 0, 0),
+		spec("fillrandom", DistributionType::Uniform, true, 0, 1, 0, 0),
+		// Workload A: Update heavy workload, 50/50 reads and writes.
+		// An application example is a session store recording recent actions.
+		spec("ycsba", DistributionType::Zipfian, false, 0.5, 0.5, 0, 0),
+		// Workload B: Read mostly workload, 95/5 reads/writes.
+		// Application example: photo tagging; add a tag is an update,
+		// but most operations are to read tags.
+		spec("ycsbb", DistributionType::Zipfian, false, 0.95, 0.05, 0, 0),
+		// Workload C: Read only. Application example: user profile cache,
+		// where profiles are constructed elsewhere (e.g., Hadoop).
+		spec("ycsbc", DistributionType::Zipfian, false, 1, 0, 0, 0),
+		// Workload D: Read latest workload, 95/5 reads/inserts.
+		// New records are inserted, and the most recently inserted records
+		// are the most popular. Application example: user status updates;
+		// people want to read the latest.
+		spec("ycsbd", DistributionType::Latest, false, 0.95, 0, 0.05, 0),
+		// Workload E: Short ranges, 95/5 scans/inserts, scan lengths uniform
+		// in [1, 100]. Application example: threaded conversations, where
+		// each scan is for the posts in a given thread (assumed to be
+		// clustered by thread id).
+		spec("ycsbe", DistributionType::Latest, false, 0, 0, 0.05, 0.95),
+		// Workload F: Read-modify-write, 50/50 reads and read-modify-writes
+		// of the Zipfian hot set. Application example: user database, where
+		// user records are read and modified by the user.
+		ycsbf,
+		// Churn: steady-state inserts of new keys and deletes of the oldest
+		// ones, with reads of recent keys, so that tombstones pile up.
+		churn,
+		// Scan after mass delete: the first half of the keyspace is deleted,
+		// then uniform scans have to skip its tombstones.
+		scanAfterDelete,
+	};
+}
 
 // ----------
 // RandomGenerator Implementation
@@ -181,16 +111,15 @@ public:
                 dist_ = std::make_unique<UniformDistribution>(minSize, maxSize);
                 break;
         }
-        // Ensure our data buffer is large enough.
-        // We choose 1MB or maxSize, whichever is larger.
-        unsigned int targetSize = std::max(1048576u, maxSize);
-        data_.reserve(targetSize);
-        // For simplicity, we fill the buffer with random printable ASCII characters.
-        std::mt19937 gen(std::random_device{}());
-        std::uniform_int_distribution<int> charDist(32, 126);
-        while (data_.size() < targetSize) {
-            data_.push_back(static_cast<char>(charDist(gen)));
-        }
+        fill(std::max(fixedSize, maxSize));
+    }
+
+    // Uses sizeDist for the length of the generated strings, which must not
+    // exceed maxSize.
+    RandomGenerator(std::unique_ptr<BaseDistribution> sizeDist, unsigned int maxSize)
+        : pos_(0), dist_(std::move(sizeDist))
+    {
+        fill(maxSize);
     }
 
     // Generates a string of exactly len characters from the pre-filled data.
@@ -210,7 +139,25 @@ public:
         return Generate(len);
     }
 
+    // Longest string Generate(len) can return.
+    size_t maxLength() const {
+        return data_.size();
+    }
+
 private:
+    void fill(unsigned int maxSize) {
+        // Ensure our data buffer is large enough.
+        // We choose 1MB or maxSize, whichever is larger.
+        unsigned int targetSize = std::max(1048576u, maxSize);
+        data_.reserve(targetSize);
+        // For simplicity, we fill the buffer with random printable ASCII characters.
+        std::mt19937 gen(std::random_device{}());
+        std::uniform_int_distribution<int> charDist(32, 126);
+        while (data_.size() < targetSize) {
+            data_.push_back(static_cast<char>(charDist(gen)));
+        }
+    }
+
     std::string data_;
     size_t pos_;
     std::unique_ptr<BaseDistribution> dist_;
@@ -220,7 +167,12 @@ private:
 // Benchmark Implementation
 // ----------
 
-Benchmark::Benchmark() = default;
+Benchmark::Benchmark() {
+	for (const auto &spec : builtinWorkloads()) {
+		specs[spec.name] = spec;
+	}
+}
+
 Benchmark::~Benchmark() = default;
 
 Result Benchmark::setup(std::unique_ptr<KVStore> kvstore, Options options) {
@@ -230,144 +182,1326 @@ Result Benchmark::setup(std::unique_ptr<KVStore> kvstore, Options options) {
 		return r;
 	}
 
-	auto adapterOptions = options.getAdapterOptionsAsMap();
-	return kv->init(adapterOptions);
+	// the load phase writes keys [0, num); inserts continue from there, and
+	// deletes of the oldest keys start at 0
+	insertFrontier = num;
+	deleteFrontier = 0;
+
+	adapterName = options.adapter;
+	adapterOptions = options.getAdapterOptionsAsMap();
+	if (use_existing) {
+		r = kv->reuseData();
+		if (!r.ok()) {
+			return r;
+		}
+	}
+	r = kv->init(adapterOptions);
+	if (!r.ok()) {
+		return r;
+	}
+	// the adapter knows its data directory once initialized
+	if (manifest.empty() && !kv->dataDirectory().empty()) {
+		manifest = kv->dataDirectory() + "/marccsman.manifest";
+	}
+	if (use_existing) {
+		if (kv->startedFresh()) {
+			return Result::Error("Adapter " + adapterName + " started empty; there is no dataset to reuse");
+		}
+		return useExistingDataset(options.getGlobalOptionsAsMap());
+	}
+	// the dataset a manifest describes is gone once the store starts empty
+	if (!manifest.empty() && kv->startedFresh()) {
+		remove(manifest.c_str());
+	}
+	return Result::OK();
+}
+
+// Takes the dataset described by the manifest as loaded: the keyspace and key
+// size come from it, so that key distributions only pick keys that exist, and
+// load steps are dropped from the run. Options that decide which keys exist
+// must agree with the manifest; others that differ are only pointed out.
+Result Benchmark::useExistingDataset(const std::map<std::string, std::string> &globalOptions) {
+	if (manifest.empty()) {
+		return Result::Error("--use_existing needs --manifest, as the adapter reports no data directory");
+	}
+	DatasetManifest m;
+	auto r = readManifest(manifest, m);
+	if (!r.ok()) {
+		return r;
+	}
+	if (m.adapter != adapterName) {
+		return Result::Error("Dataset in " + manifest + " was loaded into adapter " + m.adapter);
+	}
+	if (m.keyFormat != kPaddedDecimalKeys) {
+		return Result::Error("Dataset in " + manifest + " has unknown key format " + m.keyFormat);
+	}
+	if (globalOptions.count("num") > 0 && num != m.records) {
+		return Result::Error("--num differs from the " + std::to_string(m.records) + " records of the dataset");
+	}
+	if (globalOptions.count("key_size") > 0 && key_size != m.keySize) {
+		return Result::Error("--key_size differs from the key size " + std::to_string(m.keySize) + " of the dataset");
+	}
+	num = m.records;
+	key_size = m.keySize;
+	if (globalOptions.count("seed") == 0) {
+		seed = m.seed;
+	}
+	// reads of values without a stamp would all fail as corrupt
+	if (verify && !m.verify) {
+		return Result::Error("Dataset in " + manifest + " was not written with --verify; it cannot be verified");
+	}
+	if (m.valueDistribution != distributionName || m.valueSize != value_size ||
+	    m.valueSizeMin != value_size_min || m.valueSizeMax != value_size_max) {
+		fprintf(stderr, "Warning: values of the dataset were written with --distribution=%s --value_size=%d\n",
+		        m.valueDistribution.c_str(), m.valueSize);
+	}
+	for (const auto &option : m.adapterOptions) {
+		auto it = adapterOptions.find(option.first);
+		if (it == adapterOptions.end() || it->second != option.second) {
+			fprintf(stderr, "Warning: dataset was loaded with --%s-%s=%s\n",
+			        adapterName.c_str(), option.first.c_str(), option.second.c_str());
+		}
+	}
+	insertFrontier = std::max(m.insertFrontier, num);
+	deleteFrontier = m.deleteFrontier;
+	loadedBy = m.loadedBy;
+	loadedRecords = m.records;
+	sparseDataset = m.sparse;
+	if (m.sparse) {
+		fprintf(stderr, "Warning: dataset was loaded by %s, which drew keys at random; "
+		        "some keys of [0, %llu) are missing and reads of them find nothing\n",
+		        m.loadedBy.c_str(), static_cast<unsigned long long>(m.records));
+	}
+	// values this run writes without a stamp would leave a mixed dataset
+	stampedDataset = m.verify && verify;
+
+	std::vector<std::string> steps;
+	for (const auto &step : workloads) {
+		if (!loadsData(step)) {
+			steps.push_back(step);
+			continue;
+		}
+		std::vector<WorkloadGroup> groups;
+		parseStep(step, groups);
+		for (const auto &group : groups) {
+			if (!specs.at(group.workload).load) {
+				return Result::Error("Step " + step + " mixes a load with other workloads; it cannot skip the load");
+			}
+		}
+	}
+	workloads = steps;
+	printf("Using the dataset of %s: %llu records, loaded by %s\n", manifest.c_str(),
+	       static_cast<unsigned long long>(num), loadedBy.c_str());
+	return Result::OK();
+}
+
+Result Benchmark::saveManifest() const {
+	DatasetManifest m;
+	m.adapter = adapterName;
+	m.adapterOptions = adapterOptions;
+	m.loadedBy = loadedBy;
+	m.records = loadedRecords;
+	m.sparse = sparseDataset;
+	m.keySize = key_size;
+	m.keyFormat = kPaddedDecimalKeys;
+	m.seed = seed;
+	m.valueDistribution = distributionName;
+	m.valueSize = value_size;
+	m.valueSizeMin = value_size_min;
+	m.valueSizeMax = value_size_max;
+	m.insertFrontier = insertFrontier;
+	m.deleteFrontier = deleteFrontier;
+	m.verify = stampedDataset;
+	return writeManifest(manifest, m);
+}
+
+// The seed of a thread's random stream: random, or with --seed, derived from
+// the seed, the workload run and the thread so that reruns repeat the keys.
+uint64_t Benchmark::threadSeed(const ThreadState* thread) const {
+	if (seed == 0) {
+		return std::random_device{}();
+	}
+	return seed + 0x9e3779b97f4a7c15ULL * ((verifyEpoch << 16) + thread->tid + 1);
 }
 
 Result Benchmark::run() {
+	// measure the harness alone before touching the real store
+	if (calibration != CalibrationMode::None) {
+		// the pass moves the frontiers and the seeds on; the real run must
+		// start from where the dataset is
+		uint64_t inserted = insertFrontier.load();
+		uint64_t deleted = deleteFrontier.load();
+		uint64_t epoch = verifyEpoch;
+		NoopKVStore noop;
+		calibrating = true;
+		for (const auto &workload : workloads) {
+			auto r = runWorkload(workload, &noop, calibrationStats);
+			if (!r.ok()) {
+				calibrating = false;
+				return r;
+			}
+		}
+		calibrating = false;
+		insertFrontier = inserted;
+		deleteFrontier = deleted;
+		verifyEpoch = epoch;
+	}
+
 	// for each workload, run the benchmark
-	for (const auto &workload : workloads) {
-		std::function<void(ThreadState*)> method;
-		auto r = getWorkloadMethod(workload, method);
+	for (size_t i = 0; i < workloads.size(); i++) {
+		size_t first = stats.size();
+		Footprint fp;
+		bool measure = footprint && loadsData(workloads[i]);
+		if (measure) {
+			beginFootprint(fp);
+		}
+		auto r = searchesSlo(workloads[i]) ? searchSlo(workloads[i], stats) : runWorkload(workloads[i], kv.get(), stats);
+		if (!r.ok()) {
+			return r;
+		}
+		// the store's own view of the step goes with its first group
+		std::string storeReport = kv->takeStepReport();
+		if (!storeReport.empty() && first < stats.size()) {
+			stats[first].setStoreReport(storeReport);
+		}
+		if (measure) {
+			r = endFootprint(workloads[i], &stats[first], fp);
+			if (!r.ok()) {
+				return r;
+			}
+			stats[first].setFootprint(fp);
+		}
+		// record the dataset as soon as it is loaded, in case a later step fails
+		if (!manifest.empty() && loadsData(workloads[i])) {
+			std::vector<WorkloadGroup> groups;
+			parseStep(workloads[i], groups);
+			uint64_t before = loadedRecords;
+			for (const auto &group : groups) {
+				loadedRecords = std::max(loadedRecords, records(specs.at(group.workload)));
+			}
+			// only a sequential load of every record leaves no key out
+			bool covering = false;
+			for (const auto &group : groups) {
+				const WorkloadSpec &spec = specs.at(group.workload);
+				covering |= spec.load && keyDistribution(spec) == DistributionType::Sequential &&
+				            records(spec) >= loadedRecords;
+			}
+			sparseDataset = !covering && (loadedBy.empty() || sparseDataset || before < loadedRecords);
+			loadedBy += (loadedBy.empty() ? "" : ",") + workloads[i];
+			stampedDataset = verify;
+			r = saveManifest();
+			if (!r.ok()) {
+				return r;
+			}
+		}
+		// the calibration pass produced the same results, group by group
+		if (calibration == CalibrationMode::Annotate) {
+			for (size_t j = first; j < stats.size(); j++) {
+				// a group that did no ops, such as an empty replay, has no cost per op
+				double throughput = calibrationStats[j].avgThroughput();
+				if (throughput > 0) {
+					stats[j].setHarnessNanosPerOp(1e9 / throughput);
+				}
+			}
+		}
+	}
+
+	// the run may have inserted or deleted keys since
+	if (!manifest.empty() && !loadedBy.empty()) {
+		auto r = saveManifest();
 		if (!r.ok()) {
 			return r;
 		}
+	}
 
-		std::vector<std::thread> t;
-		std::vector<ThreadState*> workerStates;
-		for (int i = 0; i < threads; i++) {
-			auto *state = new ThreadState{i};
-			workerStates.push_back(state);
-			t.push_back(std::thread(method, state));
+	// print the results
+	if (calibration != CalibrationMode::None) {
+		reportCalibration();
+	}
+	reportSloSearches();
+	uint64_t verifyFailures = 0;
+	for (const auto &stat : stats) {
+		stat.reportFinal();
+		verifyFailures += stat.verifyFailures();
+	}
+
+	if (!trace_file.empty()) {
+		auto r = Tracer::exportChrome(trace_file);
+		if (!r.ok()) {
+			return r;
+		}
+	}
+	if (traceWriter) {
+		auto r = traceWriter->close();
+		if (!r.ok()) {
+			return r;
+		}
+	}
+	// results from a store that returns wrong data are not worth reporting as a success
+	if (verifyFailures > 0) {
+		return Result::Error(std::to_string(verifyFailures) + " reads failed verification");
+	}
+	return Result::OK();
+}
+
+// Runs one step of --workload against store and appends the combined stats
+// of each of its thread groups to results. All groups start together and
+// share one stop condition: the step ends as soon as one group has done all
+// its ops, or after duration_secs.
+Result Benchmark::runWorkload(const std::string &workload, KVStore* store, std::vector<CombinedStats> &results) {
+	std::vector<WorkloadGroup> groups;
+	auto r = parseStep(workload, groups);
+	if (!r.ok()) {
+		return r;
+	}
+	std::vector<std::function<void(ThreadState*)>> methods(groups.size());
+	for (size_t g = 0; g < groups.size(); g++) {
+		r = getWorkloadMethod(groups[g].workload, methods[g]);
+		if (!r.ok()) {
+			return r;
 		}
+	}
 
-		for (auto &thread : t) {
-			thread.join();
+	ResourceMonitor monitor(resource_interval_ms);
+	monitor.start();
+	verifyEpoch++;
+	// the calibration pass runs against another store and is not logged
+	bool logLatencies = !latency_log.empty() && store == kv.get();
+	if (logLatencies) {
+		latencyLogSteps++;
+	}
+
+	std::atomic<bool> stop{false};
+	std::mutex stopMutex;
+	std::condition_variable stopCv;
+	std::vector<std::atomic<int>> running(groups.size());
+	std::vector<std::atomic<int>> arrived(groups.size());
+
+	std::vector<std::thread> t;
+	std::vector<ThreadState*> workerStates;
+	std::vector<size_t> workerGroups;
+	std::vector<std::string> names;
+	for (const auto &group : groups) {
+		names.push_back(groups.size() > 1 ? group.workload + " (group " + std::to_string(names.size() + 1) + ")" : group.workload);
+	}
+	for (size_t g = 0; g < groups.size(); g++) {
+		running[g] = groups[g].threads;
+		for (int i = 0; i < groups[g].threads; i++) {
+			auto *state = new ThreadState{static_cast<int>(workerStates.size())};
+			state->stop = &stop;
+			state->groupIndex = i;
+			state->groupSize = groups[g].threads;
+			state->groupArrived = &arrived[g];
+			if (groups[g].opsPerSec > 0 && !calibrating) {
+				state->opIntervalMicros = 1e6 * groups[g].threads / groups[g].opsPerSec;
+			}
+			workerStates.push_back(state);
+			workerGroups.push_back(g);
+			auto &method = methods[g];
+			auto &left = running[g];
+			std::string logPath;
+			if (logLatencies) {
+				logPath = latency_log + "." + std::to_string(latencyLogSteps) + "." + std::to_string(state->tid);
+			}
+			auto &name = names[g];
+			t.push_back(std::thread([this, &method, &left, &stop, &stopMutex, &stopCv, &name, state, store, logPath]() {
+				state->cpuBegin = ResourceSample::ofThread();
+				if (perf_counters) {
+					state->stats->enablePerfCounters();
+				}
+				if (!logPath.empty()) {
+					state->result = state->stats->openLatencyLog(logPath, latency_log_ops, state->tid, name);
+				}
+				if (state->result.ok()) {
+					state->result = openSession(state, store);
+				}
+				if (state->result.ok()) {
+					method(state);
+				}
+				// sessions may be bound to their thread, so close them here
+				state->kv = nullptr;
+				state->session.reset();
+				state->cpuEnd = ResourceSample::ofThread();
+				// the last thread of a group, or a failing one, ends the step
+				if (left.fetch_sub(1) == 1 || !state->result.ok()) {
+					std::lock_guard<std::mutex> lock(stopMutex);
+					stop = true;
+					stopCv.notify_all();
+				}
+			}));
 		}
+	}
+
+	if (duration_secs > 0) {
+		std::unique_lock<std::mutex> lock(stopMutex);
+		stopCv.wait_for(lock, std::chrono::duration<double>(duration_secs), [&stop] { return stop.load(); });
+		stop = true;
+	}
+	for (auto &thread : t) {
+		thread.join();
+	}
+	ResourceUsage usage = monitor.stop();
 
-		// finally, aggregate results into CombinedStats
-		auto combinedStats = CombinedStats(workload);
-		for (const auto &state : workerStates) {
-			combinedStats.addStats(std::move(state->stats));
-			delete state;
+	for (const auto &state : workerStates) {
+		if (!state->result.ok()) {
+			r = state->result;
+			for (auto *s : workerStates) {
+				delete s;
+			}
+			return r;
 		}
+	}
 
+	// finally, aggregate results into one CombinedStats per group
+	for (size_t g = 0; g < groups.size(); g++) {
+		auto combinedStats = CombinedStats(names[g]);
+		// groups side by side share the process: each is charged the CPU of
+		// its own threads, the store's background work going to none of them
+		ResourceUsage groupUsage = usage;
+		if (groups.size() > 1) {
+			groupUsage.perGroup = true;
+			groupUsage.userSeconds = groupUsage.sysSeconds = 0;
+			groupUsage.voluntarySwitches = groupUsage.involuntarySwitches = 0;
+		}
+		for (size_t i = 0; i < workerStates.size(); i++) {
+			if (workerGroups[i] == g) {
+				if (groupUsage.perGroup) {
+					const ResourceSample &begin = workerStates[i]->cpuBegin;
+					const ResourceSample &end = workerStates[i]->cpuEnd;
+					groupUsage.userSeconds += (end.userMicros - begin.userMicros) * 1e-6;
+					groupUsage.sysSeconds += (end.sysMicros - begin.sysMicros) * 1e-6;
+					groupUsage.voluntarySwitches += end.voluntarySwitches - begin.voluntarySwitches;
+					groupUsage.involuntarySwitches += end.involuntarySwitches - begin.involuntarySwitches;
+				}
+				combinedStats.addStats(std::move(workerStates[i]->stats));
+			}
+		}
+		combinedStats.setResources(groupUsage);
 		// save the combined stats
-		stats.push_back(combinedStats);
+		results.push_back(combinedStats);
 	}
+	for (auto *state : workerStates) {
+		delete state;
+	}
+	return Result::OK();
+}
 
-	// print the results
-	for (const auto &stat : stats) {
-		stat.reportFinal();
+// Called before every op: returns false once the step must end, and holds a
+// rate-limited thread until its next op is due. Latency is then measured from
+// when the op was due, so a store that falls behind the rate is charged for it.
+bool ThreadState::nextOp() {
+	if (stop->load(std::memory_order_relaxed)) {
+		return false;
+	}
+	if (opIntervalMicros > 0) {
+		SimpleClock clock;
+		uint64_t now = clock.nowMicros();
+		if (nextOpDue == 0) {
+			nextOpDue = static_cast<double>(now);
+		}
+		uint64_t due = static_cast<uint64_t>(nextOpDue);
+		if (due > now + 200) {
+			std::this_thread::sleep_for(std::chrono::microseconds(due - now - 100));
+		}
+		while (clock.nowMicros() < due) {
+		}
+		stats->markOpStart(due);
+		nextOpDue += opIntervalMicros;
+	}
+	return true;
+}
+
+bool ThreadState::stopped() const {
+	return stop->load(std::memory_order_relaxed);
+}
+
+void Benchmark::reportCalibration() const {
+	printf("==== Harness calibration (no-op store) ====\n");
+	for (const auto &stat : calibrationStats) {
+		double opsPerSec = stat.avgThroughput();
+		if (opsPerSec > 0) {
+			printf("   %-10s : %.1f ns/op, max %.0f ops/sec per thread\n",
+			       stat.getBenchName().c_str(), 1e9 / opsPerSec, opsPerSec);
+		} else {
+			printf("   %-10s : n/a (no ops)\n", stat.getBenchName().c_str());
+		}
+	}
+	printf("========================\n");
+}
+
+// Steps with a load group, after which --footprint measures the dataset.
+bool Benchmark::loadsData(const std::string &step) const {
+	std::vector<WorkloadGroup> groups;
+	if (!parseStep(step, groups).ok()) {
+		return false;
+	}
+	for (const auto &group : groups) {
+		if (specs.at(group.workload).load) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The directory measured on disk: --data_dir, else the adapter's own.
+static std::string footprintDir(const std::string &dataDir, const KVStore &store) {
+	return dataDir.empty() ? store.dataDirectory() : dataDir;
+}
+
+void Benchmark::beginFootprint(Footprint &fp) const {
+	fp.rssBeforeBytes = ResourceSample::now().rssBytes;
+	std::string dir = footprintDir(data_dir, *kv);
+	fp.diskAvailable = !dir.empty() && directoryBytes(dir, &fp.diskBeforeBytes);
+}
+
+// Brings the store to rest after a load step and samples its footprint. The
+// adapter's quiesce() runs the work it deferred; then, as some stores
+// compact on their own schedule, the data directory is polled until its size
+// holds still or footprint_settle_secs pass. results are the step's stats,
+// one per group, which give the mean value size of each load.
+Result Benchmark::endFootprint(const std::string &step, const CombinedStats *results, Footprint &fp) {
+	SimpleClock clock;
+	uint64_t start = clock.nowMicros();
+	auto r = kv->quiesce();
+	if (!r.ok()) {
+		return r;
+	}
+	std::string dir = footprintDir(data_dir, *kv);
+	if (fp.diskAvailable) {
+		uint64_t last = UINT64_MAX;
+		for (;;) {
+			if (!directoryBytes(dir, &fp.diskAfterBytes)) {
+				fp.diskAvailable = false;
+				break;
+			}
+			if (fp.diskAfterBytes == last || (clock.nowMicros() - start) >= footprint_settle_secs * 1e6) {
+				break;
+			}
+			last = fp.diskAfterBytes;
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
 	}
+	fp.quiesceSeconds = (clock.nowMicros() - start) * 1e-6;
+	fp.rssAfterBytes = ResourceSample::now().rssBytes;
 
+	std::vector<WorkloadGroup> groups;
+	parseStep(step, groups);
+	for (size_t g = 0; g < groups.size(); g++) {
+		const WorkloadSpec &spec = specs.at(groups[g].workload);
+		if (spec.load) {
+			fp.keys += records(spec);
+			fp.logicalBytes += records(spec) * (key_size + results[g].avgValueSize());
+		}
+	}
+	fp.valid = true;
 	return Result::OK();
 }
 
+// Steps searched rather than run once: with an SLO given, every step of a
+// single group that is not a load.
+bool Benchmark::searchesSlo(const std::string &step) const {
+	std::vector<WorkloadGroup> groups;
+	if (slo_latency_us <= 0 || !parseStep(step, groups).ok() || groups.size() != 1) {
+		return false;
+	}
+	return !specs.at(groups[0].workload).load;
+}
+
+// Runs the group of step for secs at opsPerSec, or flat out if 0, and
+// appends its stats to results. A trial passes if the percentile holds and
+// the store kept up with the rate; ops it fell behind on were never issued,
+// so their latency would be missing from the percentile.
+Result Benchmark::runSloTrial(const WorkloadGroup &group, double opsPerSec, double secs, SloTrial &trial,
+                              std::vector<CombinedStats> &results) {
+	duration_secs = secs;
+	std::string step = group.workload + ":" + std::to_string(group.threads) + ":" + std::to_string(opsPerSec);
+	auto r = runWorkload(step, kv.get(), results);
+	if (!r.ok()) {
+		return r;
+	}
+	const CombinedStats &stat = results.back();
+	trial.targetOpsPerSec = opsPerSec;
+	trial.achievedOpsPerSec = stat.totalThroughput();
+	trial.latency = stat.latencyPercentile(slo_percentile);
+	trial.seconds = secs;
+	trial.pass = trial.latency <= slo_latency_us && (opsPerSec == 0 || trial.achievedOpsPerSec >= 0.95 * opsPerSec);
+	return Result::OK();
+}
+
+// Finds the highest rate at which the step's workload holds its latency
+// percentile within the SLO. A closed-loop probe bounds the rate from above,
+// then open-loop trials bisect between the highest rate that passed and the
+// lowest that failed. The rate found must then hold for a longer confirming
+// run, else it counts as failed and the search goes on below it. Only the
+// stats of the confirming run, or of the last trial if none passed, are
+// appended to results.
+Result Benchmark::searchSlo(const std::string &step, std::vector<CombinedStats> &results) {
+	std::vector<WorkloadGroup> groups;
+	auto r = parseStep(step, groups);
+	if (!r.ok()) {
+		return r;
+	}
+	const WorkloadGroup &group = groups[0];
+	SloSearch search{group.workload, {}, 0};
+	double confirmSecs = slo_confirm_secs > 0 ? slo_confirm_secs : 2 * slo_trial_secs;
+	double savedDuration = duration_secs;
+	timeBound = true;
+
+	std::vector<CombinedStats> trialStats;
+	SloTrial trial;
+	r = runSloTrial(group, 0, slo_trial_secs, trial, trialStats);
+	double low = 0;
+	double high = trial.achievedOpsPerSec;
+	if (r.ok()) {
+		search.trials.push_back(trial);
+	}
+	while (r.ok() && high > 0 && static_cast<int>(search.trials.size()) < slo_max_trials) {
+		if (high - low <= slo_tolerance * high) {
+			if (low == 0) {
+				break;
+			}
+			// confirm the best rate so far over a longer window
+			r = runSloTrial(group, low, confirmSecs, trial, trialStats);
+			if (!r.ok()) {
+				break;
+			}
+			search.trials.push_back(trial);
+			if (trial.pass) {
+				search.sustainableOpsPerSec = low;
+				break;
+			}
+			high = low;
+			low = 0;
+			continue;
+		}
+		double rate = low > 0 ? (low + high) / 2 : high / 2;
+		r = runSloTrial(group, rate, slo_trial_secs, trial, trialStats);
+		if (!r.ok()) {
+			break;
+		}
+		search.trials.push_back(trial);
+		if (trial.pass) {
+			low = rate;
+		} else {
+			high = rate;
+		}
+	}
+
+	timeBound = false;
+	duration_secs = savedDuration;
+	if (!r.ok()) {
+		return r;
+	}
+	results.push_back(trialStats.back());
+	sloSearches.push_back(search);
+	return Result::OK();
+}
+
+void Benchmark::reportSloSearches() const {
+	for (const auto &search : sloSearches) {
+		printf("==== %s SLO search: p%g <= %.1f µs ====\n", search.workload.c_str(), slo_percentile, slo_latency_us);
+		// the latency curve, by rate
+		std::vector<SloTrial> trials = search.trials;
+		std::stable_sort(trials.begin(), trials.end(), [](const SloTrial &a, const SloTrial &b) {
+			return a.targetOpsPerSec > 0 && (b.targetOpsPerSec == 0 || a.targetOpsPerSec < b.targetOpsPerSec);
+		});
+		char latency[32];
+		snprintf(latency, sizeof(latency), "p%g (µs)", slo_percentile);
+		printf("   %12s %12s %13s %8s\n", "Target/sec", "Ops/sec", latency, "Secs");
+		for (const auto &trial : trials) {
+			char target[32];
+			if (trial.targetOpsPerSec > 0) {
+				snprintf(target, sizeof(target), "%.0f", trial.targetOpsPerSec);
+			} else {
+				snprintf(target, sizeof(target), "unlimited");
+			}
+			printf("   %12s %12.0f %12.3f %8.1f  %s\n", target, trial.achievedOpsPerSec, trial.latency,
+			       trial.seconds, trial.pass ? "pass" : "fail");
+		}
+		if (search.sustainableOpsPerSec > 0) {
+			printf("   Sustainable: %.0f ops/sec\n", search.sustainableOpsPerSec);
+		} else {
+			printf("   Sustainable: no rate met the SLO\n");
+		}
+		printf("========================\n");
+	}
+}
+
+// SerializedSession funnels every op of a non-thread-safe adapter through a
+// single mutex shared by all worker threads.
+class SerializedSession : public KVSession {
+public:
+    SerializedSession(KVSession* target, std::mutex* mutex)
+        : target_(target), mutex_(mutex) {}
+
+    Result put(const std::string &key, const std::string &value) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->put(key, value);
+    }
+    Result get(const std::string &key) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->get(key);
+    }
+    Result getValue(const std::string &key, std::string *value) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->getValue(key, value);
+    }
+    Result remove(const std::string &key) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->remove(key);
+    }
+    Result scan(const std::string &start, const std::string &end) override {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        return target_->scan(start, end);
+    }
+
+private:
+    KVSession* target_;
+    std::mutex* mutex_;
+};
+
+// AllocScopedSession attributes the heap allocations made inside every op to
+// the adapter rather than to the harness.
+class AllocScopedSession : public KVSession {
+public:
+    AllocScopedSession(KVSession* target, std::unique_ptr<KVSession> owned)
+        : target_(target), owned_(std::move(owned)) {}
+
+    Result put(const std::string &key, const std::string &value) override {
+        AllocCounter::setScope(AllocScope::Adapter);
+        Result r = target_->put(key, value);
+        AllocCounter::setScope(AllocScope::Harness);
+        return r;
+    }
+    Result get(const std::string &key) override {
+        AllocCounter::setScope(AllocScope::Adapter);
+        Result r = target_->get(key);
+        AllocCounter::setScope(AllocScope::Harness);
+        return r;
+    }
+    Result getValue(const std::string &key, std::string *value) override {
+        AllocCounter::setScope(AllocScope::Adapter);
+        Result r = target_->getValue(key, value);
+        AllocCounter::setScope(AllocScope::Harness);
+        return r;
+    }
+    Result remove(const std::string &key) override {
+        AllocCounter::setScope(AllocScope::Adapter);
+        Result r = target_->remove(key);
+        AllocCounter::setScope(AllocScope::Harness);
+        return r;
+    }
+    Result scan(const std::string &start, const std::string &end) override {
+        AllocCounter::setScope(AllocScope::Adapter);
+        Result r = target_->scan(start, end);
+        AllocCounter::setScope(AllocScope::Harness);
+        return r;
+    }
+
+private:
+    KVSession* target_;
+    std::unique_ptr<KVSession> owned_;  // the wrapped session, if it was owned
+};
+
+// TracingSession records one op in every sampleEvery as a harness span, and
+// lets the adapter record its own spans while that op runs.
+class TracingSession : public KVSession {
+public:
+    TracingSession(KVSession* target, std::unique_ptr<KVSession> owned, uint64_t sampleEvery)
+        : target_(target), owned_(std::move(owned)), sampleEvery_(sampleEvery) {}
+
+    Result put(const std::string &key, const std::string &value) override {
+        if (++ops_ % sampleEvery_ != 0) {
+            return target_->put(key, value);
+        }
+        uint64_t start = beginOp();
+        Result r = target_->put(key, value);
+        endOp("put", start);
+        return r;
+    }
+    Result get(const std::string &key) override {
+        if (++ops_ % sampleEvery_ != 0) {
+            return target_->get(key);
+        }
+        uint64_t start = beginOp();
+        Result r = target_->get(key);
+        endOp("get", start);
+        return r;
+    }
+    Result getValue(const std::string &key, std::string *value) override {
+        if (++ops_ % sampleEvery_ != 0) {
+            return target_->getValue(key, value);
+        }
+        uint64_t start = beginOp();
+        Result r = target_->getValue(key, value);
+        endOp("get", start);
+        return r;
+    }
+    Result remove(const std::string &key) override {
+        if (++ops_ % sampleEvery_ != 0) {
+            return target_->remove(key);
+        }
+        uint64_t start = beginOp();
+        Result r = target_->remove(key);
+        endOp("remove", start);
+        return r;
+    }
+    Result scan(const std::string &start, const std::string &end) override {
+        if (++ops_ % sampleEvery_ != 0) {
+            return target_->scan(start, end);
+        }
+        uint64_t begin = beginOp();
+        Result r = target_->scan(start, end);
+        endOp("scan", begin);
+        return r;
+    }
+
+private:
+    uint64_t beginOp() {
+        Tracer::setSampled(true);
+        return Tracer::beginSpan();
+    }
+    void endOp(const char* name, uint64_t start) {
+        Tracer::endSpan("harness", name, start);
+        Tracer::setSampled(false);
+    }
+
+    KVSession* target_;
+    std::unique_ptr<KVSession> owned_;  // the wrapped session, if it was owned
+    uint64_t sampleEvery_;
+    uint64_t ops_ = 0;
+};
+
+// VerifyingSession stamps every value put and checks every value read back
+// (--verify). It reuses one buffer, so it adds no allocation per op.
+class VerifyingSession : public KVSession {
+public:
+    VerifyingSession(KVSession* target, std::unique_ptr<KVSession> owned, Stats* stats, int tid, uint64_t epoch)
+        : target_(target), owned_(std::move(owned)), stats_(stats), verifier_(tid, epoch) {}
+
+    Result put(const std::string &key, const std::string &value) override {
+        verifier_.stamp(key, value, &buffer_);
+        Result r = target_->put(key, buffer_);
+        if (r.ok()) {
+            verifier_.committed();
+        }
+        return r;
+    }
+    Result get(const std::string &key) override {
+        return getValue(key, &buffer_);
+    }
+    Result getValue(const std::string &key, std::string *value) override {
+        Result r = target_->getValue(key, value);
+        if (r.ok() && !value->empty()) {
+            stats_->finishedVerify(verifier_.check(key, *value));
+        }
+        return r;
+    }
+    Result remove(const std::string &key) override {
+        return target_->remove(key);
+    }
+    Result scan(const std::string &start, const std::string &end) override {
+        return target_->scan(start, end);
+    }
+
+private:
+    KVSession* target_;
+    std::unique_ptr<KVSession> owned_;  // the wrapped session, if it was owned
+    Stats* stats_;
+    ValueVerifier verifier_;
+    std::string buffer_;
+};
+
+// RecordingSession appends every op the workload issues to the op trace
+// (--record_trace) before handing it on, through a buffer of its own.
+class RecordingSession : public KVSession {
+public:
+    RecordingSession(KVSession* target, std::unique_ptr<KVSession> owned, OpTraceWriter* writer)
+        : target_(target), owned_(std::move(owned)), buffer_(writer) {}
+
+    Result put(const std::string &key, const std::string &value) override {
+        buffer_.append(TraceOp::Put, key, value.size());
+        return target_->put(key, value);
+    }
+    Result get(const std::string &key) override {
+        buffer_.append(TraceOp::Get, key, 0);
+        return target_->get(key);
+    }
+    Result getValue(const std::string &key, std::string *value) override {
+        buffer_.append(TraceOp::Get, key, 0);
+        return target_->getValue(key, value);
+    }
+    Result remove(const std::string &key) override {
+        buffer_.append(TraceOp::Remove, key, 0);
+        return target_->remove(key);
+    }
+    Result scan(const std::string &start, const std::string &end) override {
+        buffer_.append(TraceOp::Scan, start, 0, &end);
+        return target_->scan(start, end);
+    }
+
+private:
+    KVSession* target_;
+    std::unique_ptr<KVSession> owned_;  // the wrapped session, if it was owned
+    OpTraceBuffer buffer_;
+};
+
+// Points the thread at the session it must use, opening a dedicated one when
+// the adapter asks for it. The time spent opening it is kept out of the
+// measured ops and reported separately.
+Result Benchmark::openSession(ThreadState* thread, KVStore* store) {
+	switch (store->threadSafety()) {
+		case ThreadSafety::PerThread: {
+			SimpleClock clock;
+			uint64_t start = clock.nowMicros();
+			auto r = store->openSession(thread->session);
+			if (!r.ok()) {
+				return r;
+			}
+			thread->stats->finishedSessionSetup(clock.nowMicros() - start);
+			thread->kv = thread->session.get();
+			break;
+		}
+		case ThreadSafety::Serialized:
+			thread->session = std::make_unique<SerializedSession>(store, &kvMutex);
+			thread->kv = thread->session.get();
+			break;
+		case ThreadSafety::Shared:
+		default:
+			thread->kv = store;
+			break;
+	}
+	if (AllocCounter::enabled()) {
+		thread->session = std::make_unique<AllocScopedSession>(thread->kv, std::move(thread->session));
+		thread->kv = thread->session.get();
+	}
+	// ops of the calibration pass are not traced
+	if (Tracer::enabled() && store == kv.get()) {
+		Tracer::setWorkerThread(thread->tid);
+		thread->session = std::make_unique<TracingSession>(thread->kv, std::move(thread->session), trace_sample);
+		thread->kv = thread->session.get();
+	}
+	if (verify) {
+		thread->session = std::make_unique<VerifyingSession>(thread->kv, std::move(thread->session),
+		                                                     thread->stats.get(), thread->tid, verifyEpoch);
+		thread->kv = thread->session.get();
+	}
+	// the calibration pass runs against another store, and is not recorded
+	if (traceWriter && store == kv.get()) {
+		thread->session = std::make_unique<RecordingSession>(thread->kv, std::move(thread->session),
+		                                                     traceWriter.get());
+		thread->kv = thread->session.get();
+	}
+	return Result::OK();
+}
 
 Result Benchmark::parseWorkloads(std::string workloadsStr) {
 	// clear the current workloads vector
 	workloads.clear();
+	std::vector<WorkloadGroup> groups;
 	size_t pos = 0;
 	while ((pos = workloadsStr.find(",")) != std::string::npos) {
 		std::string token = workloadsStr.substr(0, pos);
 		if (!token.empty()) {
-			// check if the workload is supported
-			if (std::find(supportedWorkloads.begin(), supportedWorkloads.end(), token) == supportedWorkloads.end()) {
-				return Result::Error("Unsupported workload: " + token);
-			} else {
-				workloads.push_back(token);
+			// check that every workload of the step is supported
+			auto r = parseStep(token, groups);
+			if (!r.ok()) {
+				return r;
 			}
+			workloads.push_back(token);
 		}
 		workloadsStr.erase(0, pos + 1);
 	}
 	// Add the last token, if any
 	if (!workloadsStr.empty()) {
-		if (std::find(supportedWorkloads.begin(), supportedWorkloads.end(), workloadsStr) == supportedWorkloads.end()) {
-			return Result::Error("Unsupported workload: " + workloadsStr);
+		auto r = parseStep(workloadsStr, groups);
+		if (!r.ok()) {
+			return r;
 		}
 		workloads.push_back(workloadsStr);
 	}
 	return Result::OK();
 }
 
+// Splits a step of --workload into its thread groups. A step is one or more
+// groups joined by '+', each written <workload>[:<threads>[:<ops_per_sec>]];
+// threads defaults to the workload's threadcount, else --threads, and
+// ops_per_sec, the group's total rate limit, to the workload's target.
+Result Benchmark::parseStep(const std::string &step, std::vector<WorkloadGroup> &groups) const {
+	groups.clear();
+	std::stringstream stepStream(step);
+	std::string spec;
+	while (std::getline(stepStream, spec, '+')) {
+		std::vector<std::string> fields;
+		std::stringstream specStream(spec);
+		std::string field;
+		while (std::getline(specStream, field, ':')) {
+			fields.push_back(field);
+		}
+		if (fields.empty() || fields.size() > 3) {
+			return Result::Error("Invalid workload group: " + spec);
+		}
+		auto found = specs.find(fields[0]);
+		if (found == specs.end()) {
+			return Result::Error("Unsupported workload: " + fields[0]);
+		}
+		const WorkloadSpec &workload = found->second;
+		WorkloadGroup group{fields[0], workload.threads > 0 ? workload.threads : threads, workload.target};
+		try {
+			if (fields.size() > 1) {
+				group.threads = std::stoi(fields[1]);
+			}
+			if (fields.size() > 2) {
+				group.opsPerSec = std::stod(fields[2]);
+			}
+		} catch (const std::exception &) {
+			return Result::Error("Invalid workload group: " + spec);
+		}
+		if (group.threads <= 0 || group.opsPerSec < 0) {
+			return Result::Error("Invalid workload group: " + spec);
+		}
+		groups.push_back(group);
+	}
+	if (groups.empty()) {
+		return Result::Error("Empty workload step: " + step);
+	}
+	return Result::OK();
+}
+
 Result Benchmark::parseOptions(Options options) {
 	auto globalOptions = options.getGlobalOptionsAsMap();
 
 	for (const auto &option : globalOptions) {
 		if (option.first == "num") {
-			num = std::stoi(option.second);
+			num = std::stoull(option.second);
+		} else if (option.first == "ops") {
+			ops = std::stoull(option.second);
 		} else if (option.first == "key_size") {
 			key_size = std::stoi(option.second);
 		} else if (option.first == "value_size") {
 			value_size = std::stoi(option.second);
 		} else if (option.first == "workload") {
-			// clear the current workloads vector
-			auto r = parseWorkloads(option.second);
-			if (!r.ok()) {
-				return r;
-			}
+			// parsed below, once the workload file has defined its workloads
+			workloadsArg = option.second;
+		} else if (option.first == "workload_file") {
+			workload_file = option.second;
 		} else if (option.first == "threads") {
 			threads = std::stoi(option.second);
+		} else if (option.first == "key_distribution" || option.first.find("key_distribution:") == 0) {
+			// key_distribution:<workload> only applies to that workload
+			std::string workload = option.first == "key_distribution" ? "" : option.first.substr(17);
+			DistributionType type;
+			if (!parseKeyDistribution(option.second, type)) {
+				return Result::Error("Unknown key distribution: " + option.second);
+			}
+			key_distributions[workload] = type;
+		} else if (option.first == "zipf_skew") {
+			zipf_skew = std::stod(option.second);
+		} else if (option.first == "zipf_skew_end") {
+			zipf_skew_end = std::stod(option.second);
+		} else if (option.first == "zipf_drift_secs") {
+			zipf_drift_secs = std::stod(option.second);
+		} else if (option.first == "hot_set_fraction") {
+			hot_set_fraction = std::stod(option.second);
+		} else if (option.first == "hot_op_fraction") {
+			hot_op_fraction = std::stod(option.second);
+		} else if (option.first == "hotspot_shift_rate") {
+			hotspot_shift_rate = std::stod(option.second);
+		} else if (option.first == "duration_secs") {
+			duration_secs = std::stod(option.second);
+		} else if (option.first == "virtual_clients") {
+			virtual_clients = std::stoi(option.second);
+		} else if (option.first == "think_time_us") {
+			think_time_us = std::stoi(option.second);
+		} else if (option.first == "verify") {
+			verify = option.second == "true" || option.second == "1";
+		} else if (option.first == "perf_counters") {
+			perf_counters = option.second == "true" || option.second == "1";
+		} else if (option.first == "alloc_stats") {
+			bool on = option.second == "true" || option.second == "1";
+			if (on && !AllocCounter::available()) {
+				return Result::Error("alloc_stats needs a build configured with -DMARCCSMAN_ALLOC_COUNTER=ON");
+			}
+			AllocCounter::enable(on);
+		} else if (option.first == "trace_file") {
+			trace_file = option.second;
+		} else if (option.first == "trace_sample") {
+			trace_sample = std::stoi(option.second);
+		} else if (option.first == "trace_buffer") {
+			trace_buffer = std::stoi(option.second);
+		} else if (option.first == "latency_log") {
+			latency_log = option.second;
+		} else if (option.first == "latency_log_ops") {
+			latency_log_ops = std::stoull(option.second);
+		} else if (option.first == "seed") {
+			seed = std::stoull(option.second);
+		} else if (option.first == "manifest") {
+			manifest = option.second;
+		} else if (option.first == "use_existing") {
+			use_existing = option.second == "true" || option.second == "1";
+		} else if (option.first == "footprint") {
+			footprint = option.second == "true" || option.second == "1";
+		} else if (option.first == "footprint_settle_secs") {
+			footprint_settle_secs = std::stod(option.second);
+		} else if (option.first == "data_dir") {
+			data_dir = option.second;
+		} else if (option.first == "slo_latency_us") {
+			slo_latency_us = std::stod(option.second);
+		} else if (option.first == "slo_percentile") {
+			slo_percentile = std::stod(option.second);
+		} else if (option.first == "slo_trial_secs") {
+			slo_trial_secs = std::stod(option.second);
+		} else if (option.first == "slo_confirm_secs") {
+			slo_confirm_secs = std::stod(option.second);
+		} else if (option.first == "slo_tolerance") {
+			slo_tolerance = std::stod(option.second);
+		} else if (option.first == "slo_max_trials") {
+			slo_max_trials = std::stoi(option.second);
+		} else if (option.first == "record_trace") {
+			record_trace = option.second;
+		} else if (option.first == "replay_trace") {
+			replay_trace = option.second;
+		} else if (option.first == "replay_timing") {
+			if (option.second != "fast" && option.second != "original") {
+				return Result::Error("Unknown replay timing: " + option.second);
+			}
+			replay_original_timing = option.second == "original";
+		} else if (option.first == "calibrate") {
+			if (option.second == "none") {
+				calibration = CalibrationMode::None;
+			} else if (option.second == "report") {
+				calibration = CalibrationMode::Report;
+			} else if (option.second == "annotate") {
+				calibration = CalibrationMode::Annotate;
+			} else {
+				return Result::Error("Unknown calibration mode: " + option.second);
+			}
+		} else if (option.first == "resource_interval_ms") {
+			resource_interval_ms = std::stoi(option.second);
 		} else if (option.first == "distribution") {
-            if (option.second == "normal") {
-                distribution = DistributionType::Normal;
-            } else if (option.second == "zipfian") {
-                distribution = DistributionType::Zipfian;
-            } else if (option.second == "uniform") {
-                distribution = DistributionType::Uniform;
-            } else {
-                return Result::Error("Unknown distribution: " + option.second);
-            }
+			if (!parseValueSizeDistribution(option.second, distribution)) {
+				return Result::Error("Unknown distribution: " + option.second);
+			}
+			distributionName = option.second;
+		} else if (option.first == "value_size_min") {
+			value_size_min = std::stoi(option.second);
+		} else if (option.first == "value_size_max") {
+			value_size_max = std::stoi(option.second);
+		} else if (option.first == "pareto_scale") {
+			pareto_scale = std::stod(option.second);
+		} else if (option.first == "pareto_shape") {
+			pareto_shape = std::stod(option.second);
+		} else if (option.first == "value_size_histogram") {
+			value_size_histogram = option.second;
 		} else {
 			return Result::Error("Unknown option: " + option.first);
 		}
 	}
 
+	// value sizes: the histogram file and --distribution=histogram go together
+	if ((distribution == DistributionType::Empirical) != !value_size_histogram.empty()) {
+		return Result::Error("--distribution=histogram and --value_size_histogram must be given together");
+	}
+	if (!value_size_histogram.empty()) {
+		auto r = loadHistogram(value_size_histogram, valueSizeBuckets);
+		if (!r.ok()) {
+			return r;
+		}
+	}
+	auto r = checkValueSizes(WorkloadSpec());
+	if (!r.ok()) {
+		return r;
+	}
+
+	// the replay workload exists once there is a trace to replay
+	if (!replay_trace.empty()) {
+		WorkloadSpec replay;
+		replay.name = "replay";
+		replay.replayTrace = replay_trace;
+		replay.replayOriginalTiming = replay_original_timing;
+		specs[replay.name] = replay;
+	}
+
+	// workloads from the file, which run in file order unless --workload is given
+	if (!workload_file.empty()) {
+		std::vector<WorkloadSpec> loaded;
+		r = loadWorkloadSpecs(workload_file, loaded);
+		if (!r.ok()) {
+			return r;
+		}
+		workloads.clear();
+		for (const auto &spec : loaded) {
+			if (specs.count(spec.name) > 0) {
+				return Result::Error("Workload " + spec.name + " in " + workload_file + " is already defined");
+			}
+			r = checkValueSizes(spec);
+			if (!r.ok()) {
+				return r;
+			}
+			specs[spec.name] = spec;
+			workloads.push_back(spec.name);
+		}
+	}
+	if (!workloadsArg.empty()) {
+		r = parseWorkloads(workloadsArg);
+		if (!r.ok()) {
+			return r;
+		}
+	}
+
+	if (!trace_file.empty()) {
+		if (trace_sample <= 0 || trace_buffer <= 0) {
+			return Result::Error("trace_sample and trace_buffer must be positive");
+		}
+		Tracer::enable(trace_buffer);
+	}
+	if (slo_latency_us > 0 && (slo_percentile <= 0 || slo_percentile > 100 || slo_trial_secs <= 0 ||
+	                           slo_tolerance <= 0 || slo_max_trials <= 0)) {
+		return Result::Error("slo_percentile must be in (0, 100], and slo_trial_secs, slo_tolerance and slo_max_trials positive");
+	}
+	if (!record_trace.empty()) {
+		traceWriter = std::make_unique<OpTraceWriter>();
+		r = traceWriter->open(record_trace);
+		if (!r.ok()) {
+			return r;
+		}
+	}
+
+	return Result::OK();
+}
+
+// Checks that the value sizes of a workload can be generated.
+Result Benchmark::checkValueSizes(const WorkloadSpec &spec) const {
+	DistributionType type = spec.hasValueDistribution ? spec.valueDistribution : distribution;
+	if (type == DistributionType::Empirical && valueSizeBuckets.empty()) {
+		return Result::Error("Workload " + spec.name + " needs --value_size_histogram");
+	}
+	if (type != DistributionType::Fixed && type != DistributionType::Empirical &&
+	    (value_size_min < 0 || static_cast<unsigned int>(value_size_min) > maxValueSize(spec))) {
+		return Result::Error("value_size_min must be between 0 and the largest value size");
+	}
 	return Result::OK();
 }
 
 Result Benchmark::getWorkloadMethod(const std::string &workload, std::function<void(ThreadState*)> &method) {
-    if (workload == "fillseq") {
-        method = [this](ThreadState* thread) { writeSeq(thread); };
-    } else if (workload == "fillrandom") {
-        method = [this](ThreadState* thread) { writeRandom(thread); };
-    } else if (workload == "ycsba") {
-        method = [this](ThreadState* thread) { YCSBA(thread); };
-    } else if (workload == "ycsbb") {
-        method = [this](ThreadState* thread) { YCSBB(thread); };
-    } else if (workload == "ycsbc") {
-        method = [this](ThreadState* thread) { YCSBC(thread); };
-    } else if (workload == "ycsbd") {
-        method = [this](ThreadState* thread) { YCSBD(thread); };
-    } else if (workload == "ycsbe") {
-        method = [this](ThreadState* thread) { YCSBE(thread); };
-    } else {
+    auto found = specs.find(workload);
+    if (found == specs.end()) {
         return Result::Error("Unknown workload: " + workload);
     }
+    const WorkloadSpec *spec = &found->second;
+    if (!spec->replayTrace.empty()) {
+        method = [this, spec](ThreadState* thread) { runReplay(thread, *spec); };
+    } else if (virtual_clients > 0 && !spec->load) {
+        method = [this, spec](ThreadState* thread) { runVirtualClients(thread, *spec); };
+    } else {
+        method = [this, spec](ThreadState* thread) { runSpec(thread, *spec); };
+    }
     return Result::OK();
 }
 
-void Benchmark::writeSeq(ThreadState* thread) {
-	doWrite(thread, WriteMode::SEQUENTIAL);
+// The key distribution of a workload: its own --key_distribution:<workload>
+// override, else --key_distribution, else the workload's default. Loads
+// ignore --key_distribution and keep their own: fillseq writes every key of
+// [0, records), while fillrandom draws keys uniformly with replacement and
+// leaves some of them out.
+DistributionType Benchmark::keyDistribution(const WorkloadSpec &spec) const {
+	auto it = key_distributions.find(spec.name);
+	if (it == key_distributions.end() && !spec.load) {
+		it = key_distributions.find("");
+	}
+	return it != key_distributions.end() ? it->second : spec.keyDistribution;
 }
 
-void Benchmark::writeRandom(ThreadState* thread) {
-	doWrite(thread, WriteMode::RANDOM);
+std::unique_ptr<BaseDistribution> Benchmark::newKeyDistribution(const WorkloadSpec &spec) {
+	DistributionType type = keyDistribution(spec);
+	uint64_t max = records(spec) - 1;
+	switch (type) {
+		case DistributionType::Sequential:
+			return std::make_unique<SequentialDistribution>(0, max);
+		case DistributionType::Normal:
+			return std::make_unique<NormalDistribution>(0, max);
+		case DistributionType::Zipfian:
+			return std::make_unique<ZipfianDistribution>(0, max, zipf_skew);
+		case DistributionType::Latest:
+			return std::make_unique<LatestDistribution>(&insertFrontier, zipf_skew);
+		case DistributionType::Hotspot:
+			return std::make_unique<HotspotDistribution>(0, max, hot_set_fraction, hot_op_fraction);
+		case DistributionType::ShiftingHotspot:
+			return std::make_unique<HotspotDistribution>(0, max, hot_set_fraction, hot_op_fraction,
+			                                             hotspot_shift_rate);
+		case DistributionType::DriftingZipfian:
+			return std::make_unique<DriftingZipfianDistribution>(0, max, zipf_skew, zipf_skew_end,
+			                                                     zipf_drift_secs);
+		case DistributionType::Uniform:
+		default:
+			return std::make_unique<UniformDistribution>(0, max);
+	}
+}
+
+// Builds the distribution of value sizes of a workload: its fieldlength
+// settings, else --distribution and --value_size.
+std::unique_ptr<BaseDistribution> Benchmark::newValueSizeDistribution(const WorkloadSpec &spec) const {
+	unsigned int max = maxValueSize(spec);
+	switch (spec.hasValueDistribution ? spec.valueDistribution : distribution) {
+		case DistributionType::Uniform:
+			return std::make_unique<UniformDistribution>(value_size_min, max);
+		case DistributionType::Normal:
+			return std::make_unique<NormalDistribution>(value_size_min, max);
+		case DistributionType::Zipfian:
+			return std::make_unique<ZipfianDistribution>(value_size_min, max, zipf_skew);
+		case DistributionType::Pareto:
+			return std::make_unique<ParetoDistribution>(value_size_min, max, pareto_scale, pareto_shape);
+		case DistributionType::Empirical:
+			return std::make_unique<EmpiricalDistribution>(valueSizeBuckets);
+		case DistributionType::Fixed:
+		default:
+			return std::make_unique<FixedDistribution>(max);
+	}
+}
+
+// Largest value the size distribution of a workload can produce.
+unsigned int Benchmark::maxValueSize(const WorkloadSpec &spec) const {
+	DistributionType type = spec.hasValueDistribution ? spec.valueDistribution : distribution;
+	int size = spec.valueSize > 0 ? spec.valueSize : value_size;
+	if (type == DistributionType::Fixed) {
+		return size;
+	}
+	if (type == DistributionType::Empirical) {
+		uint64_t max = 0;
+		for (const auto &bucket : valueSizeBuckets) {
+			max = std::max(max, bucket.max);
+		}
+		return static_cast<unsigned int>(max);
+	}
+	// value_size_max only bounds workloads that take their size from the command line
+	if (spec.valueSize > 0) {
+		return 2 * size;
+	}
+	return value_size_max > 0 ? value_size_max : 2 * size;
+}
+
+// Keys in the keyspace of a workload.
+uint64_t Benchmark::records(const WorkloadSpec &spec) const {
+	return spec.recordCount > 0 ? spec.recordCount : num;
+}
+
+// Ops each thread issues: the workload's operationcount, else the record
+// count for load workloads and --ops (or num) for the others.
+uint64_t Benchmark::opsPerThread(const WorkloadSpec &spec) const {
+	if (timeBound) {
+		return UINT64_MAX;
+	}
+	if (spec.operationCount > 0) {
+		return spec.operationCount;
+	}
+	if (spec.load) {
+		return records(spec);
+	}
+	return ops > 0 ? ops : num;
 }
 
 // Helper function to pad an integer with leading zeros to match key_size.
-std::string paddedKey(int number, size_t key_size) {
+std::string paddedKey(uint64_t number, size_t key_size) {
     std::string key = std::to_string(number);
     if (key.size() < key_size) {
         key.insert(key.begin(), key_size - key.size(), '0');
@@ -375,190 +1509,274 @@ std::string paddedKey(int number, size_t key_size) {
     return key;
 }
 
-void Benchmark::doWrite(ThreadState* thread, WriteMode mode) {
-    thread->stats->start();
-    RandomGenerator rng(DistributionType::Uniform, 0, 1, key_size);
-    for (int i = 0; i < num; i++) {
-        std::string value = rng.Generate(value_size);
-        std::string key;
-        if (mode == WriteMode::RANDOM) {
-            key = paddedKey(rand() % num, key_size);
+// Everything a thread needs to issue the ops of a workload. Ops are picked by
+// walking the cumulative proportions, so the dispatch is a handful of compares.
+struct SpecContext {
+    SpecContext(const WorkloadSpec &spec,
+                std::unique_ptr<BaseDistribution> keys,
+                std::unique_ptr<BaseDistribution> valueSizes, unsigned int maxValueSize)
+        : keyDist(std::move(keys)), valueGen(std::move(valueSizes), maxValueSize) {
+        double total = 0;
+        for (double proportion : spec.proportions) {
+            total += proportion;
+        }
+        double sum = 0;
+        for (int i = 0; i < kNumSpecOps; i++) {
+            sum += spec.proportions[i];
+            cumulative[i] = sum / total;
+            if (spec.proportions[i] > 0) {
+                lastOp = static_cast<SpecOp>(i);
+            }
+        }
+        deleteOldest = spec.deleteOldest;
+        if (spec.scanLengthDistribution == DistributionType::Zipfian) {
+            scanLenDist = std::make_unique<ZipfianDistribution>(spec.minScanLength, spec.maxScanLength);
         } else {
-            key = paddedKey(i, key_size);
+            scanLenDist = std::make_unique<UniformDistribution>(spec.minScanLength, spec.maxScanLength);
         }
-        kv->put(key, value);
-        uint64_t size = key.size() + value.size();
-        thread->stats->finishedWriteOp(size);
     }
-    thread->stats->stop();
-}
 
-// Workload A: Update heavy workload
-// This workload has a mix of 50/50 reads and writes.
-// An application example is a session store recording recent actions.
-void Benchmark::YCSBA(ThreadState* thread) {
-    // Start the timing for this thread’s workload.
-    thread->stats->start();
+    SpecOp chooseOp(FastRandom &rng) const {
+        double u = static_cast<double>(rng() >> 11) * 0x1.0p-53;
+        for (int i = 0; i < kNumSpecOps; i++) {
+            if (u < cumulative[i]) {
+                return static_cast<SpecOp>(i);
+            }
+        }
+        return lastOp;   // only reached through rounding
+    }
 
-    RandomGenerator valueGen(DistributionType::Uniform, 0, 1, value_size);
-    ZipfianDistribution keyDist(0, num - 1);
+    double cumulative[kNumSpecOps];
+    SpecOp lastOp = SpecOp::READ;
+    bool deleteOldest;
+    std::unique_ptr<BaseDistribution> keyDist;
+    std::unique_ptr<BaseDistribution> scanLenDist;
+    RandomGenerator valueGen;
+};
 
-    for (int i = 0; i < num; i++) {
-        // Generate a key using the Zipfian distribution.
-        unsigned int key_num = keyDist.Generate();
-        std::string key = paddedKey(key_num, key_size);
+// Issues one op and records it in the thread's stats.
+void Benchmark::doOp(ThreadState* thread, SpecContext &ctx, SpecOp op, FastRandom &rng) {
+    if (op == SpecOp::INSERT) {
+        // a new key at the insert frontier
+        std::string key = paddedKey(insertFrontier.fetch_add(1), key_size);
+        std::string value = ctx.valueGen.Generate();
+        thread->kv->put(key, value);
+        thread->stats->finishedWriteOp(key.size() + value.size());
+        thread->stats->recordValueSize(value.size());
+        return;
+    }
 
-        // Decide randomly whether to do read or update (50/50).
-        if ((rand() % 100) < 50) {
-            // Read operation.
-            Result r = kv->get(key);
+    if (op == SpecOp::DELETE && ctx.deleteOldest) {
+        // the oldest key still alive; past the insert frontier, there is none
+        std::string key = paddedKey(deleteFrontier.fetch_add(1), key_size);
+        thread->kv->remove(key);
+        thread->stats->finishedDeleteOp(key.size());
+        return;
+    }
+
+    uint64_t key_num = ctx.keyDist->Generate(rng);
+    std::string key = paddedKey(key_num, key_size);
+    switch (op) {
+        case SpecOp::READ: {
+            Result r = thread->kv->get(key);
             thread->stats->finishedReadOp(key.size(), r.ok());
-        } else {
-            // Update operation: generate a new value and perform a put.
-            std::string newValue = valueGen.Generate(value_size);
-            Result r = kv->put(key, newValue);
-            thread->stats->finishedWriteOp(key.size());
+            break;
+        }
+        case SpecOp::UPDATE: {
+            std::string value = ctx.valueGen.Generate();
+            thread->kv->put(key, value);
+            thread->stats->finishedWriteOp(key.size() + value.size());
+            thread->stats->recordValueSize(value.size());
+            break;
+        }
+        case SpecOp::SCAN: {
+            uint64_t scan_len = ctx.scanLenDist->Generate(rng);
+            std::string end_key = paddedKey(key_num + scan_len, key_size);
+            Result r = thread->kv->scan(key, end_key);
+            thread->stats->finishedScanOp(end_key.size() * scan_len, r.ok());
+            break;
+        }
+        case SpecOp::DELETE: {
+            thread->kv->remove(key);
+            thread->stats->finishedDeleteOp(key.size());
+            break;
         }
+        case SpecOp::RMW: {
+            Result r = thread->kv->get(key);
+            thread->stats->finishedRmwRead();
+            std::string value = ctx.valueGen.Generate();
+            thread->kv->put(key, value);
+            thread->stats->finishedRmwOp(key.size() + value.size(), r.ok());
+            thread->stats->recordValueSize(value.size());
+            break;
+        }
+        default:
+            break;
     }
-
-    thread->stats->stop();
 }
 
-// Workload B: Read mostly workload
-// This workload has a 95/5 reads/write mix.
-// Application example: photo tagging; add a tag is an update,
-// but most operations are to read tags.
-void Benchmark::YCSBB(ThreadState* thread) {
-    // Start the timing for this thread’s workload.
-    thread->stats->start();
-
-    RandomGenerator valueGen(DistributionType::Uniform, 0, 1, value_size);
-    ZipfianDistribution keyDist(0, num - 1);
+// Deletes the first massdeletefraction of the keyspace, split between the
+// threads of the group, before the measured ops. Every thread waits for the
+// others, so that the ops all see the whole delete.
+void Benchmark::massDelete(ThreadState* thread, const WorkloadSpec &spec) {
+    if (spec.massDeleteFraction <= 0) {
+        return;
+    }
+    uint64_t end = static_cast<uint64_t>(spec.massDeleteFraction * records(spec));
+    for (uint64_t k = thread->groupIndex; k < end && !thread->stopped(); k += thread->groupSize) {
+        thread->kv->remove(paddedKey(k, key_size));
+    }
+    thread->groupArrived->fetch_add(1);
+    while (thread->groupArrived->load() < thread->groupSize && !thread->stopped()) {
+        std::this_thread::yield();
+    }
+}
 
-    for (int i = 0; i < num; i++) {
-        // Generate a key using the Zipfian distribution.
-        unsigned int key_num = keyDist.Generate();
-        std::string key = paddedKey(key_num, key_size);
+// The op loop of every workload run by closed-loop threads.
+void Benchmark::runSpec(ThreadState* thread, const WorkloadSpec &spec) {
+    SpecContext ctx(spec, newKeyDistribution(spec), newValueSizeDistribution(spec), maxValueSize(spec));
+    FastRandom rng(threadSeed(thread));
+    uint64_t n = opsPerThread(spec);
+    massDelete(thread, spec);
 
-        // Decide randomly whether to do read or update (95/5).
-        if ((rand() % 100) < 95) {
-            // Read operation.
-            Result r = kv->get(key);
-            thread->stats->finishedReadOp(key.size(), r.ok());
-        } else {
-            // Update operation: generate a new value and perform a put.
-            std::string newValue = valueGen.Generate(value_size);
-            Result r = kv->put(key, newValue);
-            thread->stats->finishedWriteOp(key.size());
-        }
+    thread->stats->start();
+    for (uint64_t i = 0; i < n && thread->nextOp(); i++) {
+        doOp(thread, ctx, ctx.chooseOp(rng), rng);
     }
-
     thread->stats->stop();
 }
 
-// Workload C: Read only
-// This workload is 100% read. Application example: user profile cache,
-// where profiles are constructed elsewhere (e.g., Hadoop).
-void Benchmark::YCSBC(ThreadState* state) {
-    // Start the timing for this thread’s workload.
-    state->stats->start();
+// Virtual clients: each thread multiplexes many lightweight clients, kept as
+// plain state machines ordered by when their next op is due. A client issues
+// one op, thinks for an exponentially distributed time and becomes due again.
+// Latency is measured from when an op was due, so time spent queued behind
+// other clients of the same thread counts, as it would for a real client. A
+// group rate limit caps the ops of the thread, all clients together; an op
+// held back by it is late, and its wait counts too.
+void Benchmark::runVirtualClients(ThreadState* thread, const WorkloadSpec &spec) {
+    struct VirtualClient {
+        FastRandom rng;   // the client's own random stream; the thread's clients share its key distribution
+    };
+    using Due = std::pair<uint64_t, int>;   // (due time in micros, client)
 
-    // Use Zipfian distribution for keys over the range [0, num-1]
-    // ZipfianDistribution keyDist(0, num - 1, 1.2);
-    ZipfianDistribution keyDist(0, num - 1);
+    SimpleClock clock;
+    FastRandom seeder(threadSeed(thread));
+    int thinkMicros = calibrating ? 0 : think_time_us;   // the harness alone never waits
+    std::exponential_distribution<double> thinkDist(thinkMicros > 0 ? 1.0 / thinkMicros : 1.0);
+    SpecContext ctx(spec, newKeyDistribution(spec), newValueSizeDistribution(spec), maxValueSize(spec));
+    uint64_t n = opsPerThread(spec);
+    massDelete(thread, spec);
 
-    for (int i = 0; i < num; i++) {
-        // Generate a key using the Zipfian distribution.
-        unsigned int key_num = keyDist.Generate();
-        std::string key = paddedKey(key_num, key_size);
+    thread->stats->start();
 
-        // Read operation.
-        Result r = kv->get(key);
-        state->stats->finishedReadOp(key.size(), r.ok());
+    // Spread the clients' first ops over one think time.
+    std::vector<VirtualClient> clients;
+    clients.reserve(virtual_clients);
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+    uint64_t now = clock.nowMicros();
+    for (int c = 0; c < virtual_clients; c++) {
+        clients.push_back(VirtualClient{FastRandom(seeder())});
+        uint64_t jitter = thinkMicros > 0 ? clients[c].rng() % thinkMicros : 0;
+        due.push(Due(now + jitter, c));
     }
 
-    state->stats->stop();
-}
+    for (uint64_t i = 0; i < n && !thread->stopped(); i++) {
+        Due next = due.top();
+        due.pop();
+        VirtualClient &client = clients[next.second];
 
-// Workload D: Read latest workload
-// This workload has 95/0/5 read/update/insert mix.
-// In this workload, new records are inserted, and the most recently
-// inserted records are the most popular. Application example:
-// user status updates; people want to read the latest.
-void Benchmark::YCSBD(ThreadState* state) {
-    // Start the timing for this thread’s workload.
-    state->stats->start();
+        // Every client is thinking: wait for the first one to be due, and for
+        // the rate limit to let an op through, with sleeps for long gaps and
+        // spinning for short ones.
+        now = clock.nowMicros();
+        uint64_t start = next.first;
+        if (thread->opIntervalMicros > 0) {
+            start = std::max(start, static_cast<uint64_t>(thread->nextOpDue));
+            thread->nextOpDue = start + thread->opIntervalMicros;
+        }
+        if (start > now + 200) {
+            std::this_thread::sleep_for(std::chrono::microseconds(start - now - 100));
+        }
+        while (clock.nowMicros() < start) {
+        }
+        thread->stats->markOpStart(next.first);
 
-    // Use Zipfian distribution for keys over the range [0, num-1]
-    // ZipfianDistribution keyDist(0, num - 1, 1.2);
-    LatestDistribution keyDist(0, num - 1);
+        doOp(thread, ctx, ctx.chooseOp(client.rng), client.rng);
 
-    for (int i = 0; i < num; i++) {
-        int nextOp = rand() % 100;
-        if (nextOp < 95) {
-            // Read operation.
-            unsigned int key_num = keyDist.Generate();
-            std::string key = paddedKey(key_num, key_size);
-            Result r = kv->get(key);
-            state->stats->finishedReadOp(key.size(), r.ok());
-        } else {
-            // Update operation: generate a new value and perform a put.
-            RandomGenerator valueGen(DistributionType::Uniform, 0, 1, value_size);
-            unsigned int key_num = keyDist.Generate();
-            std::string key = paddedKey(key_num, key_size);
-            std::string newValue = valueGen.Generate(value_size);
-            Result r = kv->put(key, newValue);
-            state->stats->finishedWriteOp(key.size());
-        }
+        uint64_t think = thinkMicros > 0 ? static_cast<uint64_t>(thinkDist(client.rng)) : 0;
+        due.push(Due(clock.nowMicros() + think, next.second));
     }
 
-    state->stats->stop();
-}
-
-// Workload E: Short ranges.
-// In this workload, short ranges of records are queried,
-// instead of individual records. Application example:
-// threaded conversations, where each scan is for the posts
-// in a given thread (assumed to be clustered by thread id).
-
-// Scan/insert ratio: 95/5
-// Request distribution: latest
-// Scan Length Distribution=uniform
-// Max scan length = 100
-
-// The insert order is hashed, not ordered. Although the scans are ordered, it
-// does not necessarily follow that the data is inserted in order. For
-// example, posts for thread 342 may not be inserted contiguously, but instead
-// interspersed with posts from lots of other threads. The way the YCSB client
-// works is that it will pick a start key, and then request a number of
-// records; this works fine even for hashed insertion.
-void Benchmark::YCSBE(ThreadState* state) {
-    state->stats->start();
-
-    LatestDistribution keyDist(0, num - 1, 1.2);
-    UniformDistribution scanLenDist(1, 100);
-    RandomGenerator valueGen(DistributionType::Uniform, 0, 1, value_size);
-
-    for (int i = 0; i < num; i++) {
-        int op = rand() % 100;
-        if (op < 95) {
-            // Scan operation
-            unsigned int key_num = keyDist.Generate();
-            std::string start_key = paddedKey(key_num, key_size);
-            unsigned int scan_len = scanLenDist.Generate();
-            std::string end_key = paddedKey(key_num + scan_len, key_size);
+    thread->stats->stop();
+}
 
-            Result r = kv->scan(start_key, end_key);
-            size_t size = end_key.size() * scan_len;
-            state->stats->finishedReadOp(size, r.ok());
-        } else {
-            // Update operation
-            unsigned int key_num = keyDist.Generate();
-            std::string key = paddedKey(key_num, key_size);
-            std::string newValue = valueGen.Generate(value_size);
-            Result r = kv->put(key, newValue);
-            state->stats->finishedWriteOp(key.size());
+// Replays an op trace. Every thread of the group walks the whole trace and
+// issues the ops whose key hashes to it, so each key keeps its recorded op
+// order. With original timing an op is due at its recorded offset from the
+// start of the replay, and its latency is measured from then.
+void Benchmark::runReplay(ThreadState* thread, const WorkloadSpec &spec) {
+    OpTraceReader reader;
+    thread->result = reader.open(spec.replayTrace);
+    if (!thread->result.ok()) {
+        return;
+    }
+    RandomGenerator valueGen(std::make_unique<FixedDistribution>(value_size), value_size);
+    std::hash<std::string> hash;
+    SimpleClock clock;
+    TraceRecord record;
+    std::string key, endKey;
+
+    thread->stats->start();
+    uint64_t start = clock.nowMicros();
+    uint64_t lastDue = start;
+    while (reader.next(record) && !thread->stopped()) {
+        key.assign(record.key, record.keySize);
+        if (hash(key) % thread->groupSize != static_cast<size_t>(thread->groupIndex)) {
+            continue;
+        }
+        if (spec.replayOriginalTiming && !calibrating) {
+            // the chunks of the recording threads overlap in time: an op
+            // listed after a later one is due with it
+            uint64_t due = std::max(start + record.micros, lastDue);
+            lastDue = due;
+            uint64_t now = clock.nowMicros();
+            if (due > now + 200) {
+                std::this_thread::sleep_for(std::chrono::microseconds(due - now - 100));
+            }
+            while (clock.nowMicros() < due) {
+            }
+            thread->stats->markOpStart(due);
+        }
+        switch (record.op) {
+            case TraceOp::Get: {
+                Result r = thread->kv->get(key);
+                thread->stats->finishedReadOp(key.size(), r.ok());
+                break;
+            }
+            case TraceOp::Put: {
+                // values too large for the generator are cut to its buffer
+                std::string value = valueGen.Generate(std::min<uint64_t>(record.valueSize, valueGen.maxLength()));
+                thread->kv->put(key, value);
+                thread->stats->finishedWriteOp(key.size() + value.size());
+                thread->stats->recordValueSize(value.size());
+                break;
+            }
+            case TraceOp::Remove:
+                thread->kv->remove(key);
+                thread->stats->finishedDeleteOp(key.size());
+                break;
+            case TraceOp::Scan: {
+                endKey.assign(record.endKey, record.endKeySize);
+                Result r = thread->kv->scan(key, endKey);
+                thread->stats->finishedScanOp(key.size() + endKey.size(), r.ok());
+                break;
+            }
+            default:
+                break;
         }
     }
-    state->stats->stop();
-}
\ No newline at end of file
+    thread->stats->stop();
+    if (!reader.error().ok()) {
+        thread->result = reader.error();
+    }
+}
@@ -1,30 +1,73 @@
 #ifndef BENCHMARK_H
 #define BENCHMARK_H
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
 
+#include "distribution.h"
 #include "result.h"
 #include "options.h"
 #include "kvstore.h"
+#include "manifest.h"
+#include "op_trace.h"
 #include "stats.h"
+#include "workload_spec.h"
 
 enum WriteMode { RANDOM, SEQUENTIAL };
 
-// Define the types of distributions you want.
-enum class DistributionType {
-    Fixed,
-    Uniform,
-    Normal,
-    Zipfian,
-    Latest
+// Whether to measure the harness itself against a no-op store first.
+enum class CalibrationMode {
+    None,
+    Report,    // report harness cost per workload
+    Annotate   // also annotate every result with its harness overhead
 };
 
+// One group of threads running a workload within a step of --workload.
+struct WorkloadGroup {
+	std::string workload;
+	int threads;
+	double opsPerSec;   // rate limit of the whole group, 0 for none
+};
+
+// One run of the SLO search at a given rate.
+struct SloTrial {
+	double targetOpsPerSec;     // 0 for the closed-loop probe
+	double achievedOpsPerSec;
+	double latency;             // the searched percentile, in µs
+	double seconds;
+	bool pass;
+};
+
+// The trials of the SLO search of one step, and the rate it settled on.
+struct SloSearch {
+	std::string workload;
+	std::vector<SloTrial> trials;
+	double sustainableOpsPerSec;   // 0 if no rate met the SLO
+};
+
+struct SpecContext;
+
 struct ThreadState {
 	int tid;
 	std::unique_ptr<Stats> stats;
+	KVSession* kv = nullptr;              // what the workload issues ops against
+	std::unique_ptr<KVSession> session;   // owned per-thread session, if any
+	Result result = Result::OK();
+	const std::atomic<bool>* stop = nullptr;   // set when the step must end
+	int groupIndex = 0;                   // this thread's rank in its group
+	int groupSize = 1;
+	std::atomic<int>* groupArrived = nullptr;  // threads of the group done with their setup
+	double opIntervalMicros = 0;          // rate limit: time between ops, 0 for none
+	double nextOpDue = 0;                 // when the next rate-limited op is due, in micros
+	ResourceSample cpuBegin;              // the thread's own CPU use, around its workload
+	ResourceSample cpuEnd;
 
 	ThreadState(int id) : tid(id), stats(std::make_unique<Stats>()) {}
+
+	bool nextOp();
+	bool stopped() const;
 };
 
 class Benchmark {
@@ -37,29 +80,109 @@ public:
 
 private:
 	std::unique_ptr<KVStore> kv;
-	int num = 1000;
+	std::mutex kvMutex;   // serializes ops for ThreadSafety::Serialized adapters
+	std::atomic<uint64_t> insertFrontier{0};   // next key number inserts write
+	std::atomic<uint64_t> deleteFrontier{0};   // next key number deletes of the oldest key remove
+	uint64_t num = 1000;                // keys in the dataset
+	uint64_t ops = 0;                   // ops per thread in run workloads, 0 means num
 	int key_size = 16;
 	int value_size = 1000;
-	DistributionType distribution = DistributionType::Uniform;
-	std::vector<std::string> workloads = {"fillseq"};
+	DistributionType distribution = DistributionType::Fixed;   // value sizes
+	int value_size_min = 1;            // smallest value of the variable size distributions
+	int value_size_max = 0;            // largest value, 0 means 2 * value_size
+	double pareto_scale = 214.476;     // pareto: defaults fit Facebook's ETC pool
+	double pareto_shape = 0.348238;
+	std::string value_size_histogram;  // histogram file of value sizes
+	std::vector<HistogramBucket> valueSizeBuckets;
+	// key distributions: one for every workload, and overrides for single ones
+	std::map<std::string, DistributionType> key_distributions;   // "" holds the one for every workload but loads
+	double zipf_skew = 1.2;
+	double zipf_skew_end = 0.6;        // drifting_zipfian: skew reached after zipf_drift_secs
+	double zipf_drift_secs = 60;
+	double hot_set_fraction = 0.2;     // hotspot: share of the keys that are hot
+	double hot_op_fraction = 0.8;      // hotspot: share of the ops that go to hot keys
+	double hotspot_shift_rate = 0.01;  // shifting_hotspot: share of the keyspace the hot set moves per second
+	std::vector<std::string> workloads = {"fillseq"};   // steps of the run, see parseStep
+	std::string workloadsArg;          // --workload, parsed after the options
+	std::string workload_file;         // workload specs to add to the built-in ones
+	std::map<std::string, WorkloadSpec> specs;   // every workload, by name
 	int threads = 1;
+	double duration_secs = 0;          // ends every step after this long, 0 for no limit
+	int virtual_clients = 0;           // virtual clients multiplexed on each thread, 0 to disable
+	int think_time_us = 0;             // mean think time of a virtual client between ops
+	bool verify = false;               // stamp values and check them on reads
+	uint64_t verifyEpoch = 0;          // bumped for every workload run, see ValueVerifier
+	uint64_t seed = 0;                 // seeds the threads' random streams, 0 for random seeds
+	bool perf_counters = false;        // per-thread hardware counters via perf_event_open
+	int resource_interval_ms = 1000;   // RSS sampling period, 0 samples only at boundaries
+	CalibrationMode calibration = CalibrationMode::None;
+	bool calibrating = false;          // the no-op pass runs: no rate limits, think times or recorded pacing
+	std::string trace_file;            // Chrome trace-event output, empty to disable tracing
+	int trace_sample = 100;            // trace one op in every trace_sample per thread
+	int trace_buffer = 65536;          // spans kept per thread
+	std::string latency_log;           // prefix of the per-thread latency logs, empty to disable
+	uint64_t latency_log_ops = 1 << 20;   // ops each latency log keeps
+	int latencyLogSteps = 0;           // steps logged so far, which number the log files
+	std::string record_trace;          // op trace of every op issued, empty to disable
+	std::string replay_trace;          // op trace the replay workload replays
+	bool replay_original_timing = false;   // replay at the recorded pace
+	std::unique_ptr<OpTraceWriter> traceWriter;
+	double slo_latency_us = 0;         // SLO search: latency bound of run steps, 0 to run them once
+	double slo_percentile = 99;        // SLO search: the percentile held to slo_latency_us
+	double slo_trial_secs = 5;         // SLO search: length of a trial at one rate
+	double slo_confirm_secs = 0;       // SLO search: length of the run confirming a rate, 0 means 2 trials
+	double slo_tolerance = 0.05;       // SLO search: stops once the rate is known to within this share
+	int slo_max_trials = 20;
+	bool timeBound = false;            // ops run until duration_secs, whatever their count
+	std::vector<SloSearch> sloSearches;
+	bool footprint = false;            // measure memory and disk per key around load steps
+	double footprint_settle_secs = 10; // longest wait for the data directory to stop changing
+	std::string data_dir;              // measured on disk; defaults to the adapter's data directory
+	std::string manifest;              // dataset manifest; defaults to marccsman.manifest in the adapter's data directory
+	bool use_existing = false;         // run against the dataset of the manifest, skipping load steps
+	std::string distributionName = "fixed";   // --distribution as given, for the manifest
+	std::string adapterName;
+	std::map<std::string, std::string> adapterOptions;
+	std::string loadedBy;              // load steps of the dataset, for the manifest
+	uint64_t loadedRecords = 0;
+	bool sparseDataset = false;        // no load wrote every key of [0, loadedRecords)
+	bool stampedDataset = false;       // every value of the dataset carries a --verify stamp
 
 	std::vector<CombinedStats> stats;
+	std::vector<CombinedStats> calibrationStats;
 
 	Result parseOptions(Options options);
 	Result parseWorkloads(std::string workloadsStr);
+	Result parseStep(const std::string &step, std::vector<WorkloadGroup> &groups) const;
 	Result getWorkloadMethod(const std::string &workload, std::function<void(ThreadState*)> &method);
+	Result runWorkload(const std::string &workload, KVStore* store, std::vector<CombinedStats> &results);
+	Result openSession(ThreadState* thread, KVStore* store);
+	uint64_t records(const WorkloadSpec &spec) const;
+	uint64_t opsPerThread(const WorkloadSpec &spec) const;
+	DistributionType keyDistribution(const WorkloadSpec &spec) const;
+	std::unique_ptr<BaseDistribution> newKeyDistribution(const WorkloadSpec &spec);
+	std::unique_ptr<BaseDistribution> newValueSizeDistribution(const WorkloadSpec &spec) const;
+	unsigned int maxValueSize(const WorkloadSpec &spec) const;
+	Result checkValueSizes(const WorkloadSpec &spec) const;
+	void reportCalibration() const;
+	uint64_t threadSeed(const ThreadState* thread) const;
+	Result useExistingDataset(const std::map<std::string, std::string> &globalOptions);
+	Result saveManifest() const;
+	bool loadsData(const std::string &step) const;
+	void beginFootprint(Footprint &fp) const;
+	Result endFootprint(const std::string &step, const CombinedStats *results, Footprint &fp);
+	bool searchesSlo(const std::string &step) const;
+	Result searchSlo(const std::string &step, std::vector<CombinedStats> &results);
+	Result runSloTrial(const WorkloadGroup &group, double opsPerSec, double secs, SloTrial &trial,
+	                   std::vector<CombinedStats> &results);
+	void reportSloSearches() const;
 
 	// Workload methods
-	void writeSeq(ThreadState* thread);
-	void writeRandom(ThreadState* thread);
-	void doWrite(ThreadState* thread, WriteMode mode);
-	void readRandom(ThreadState* thread);
-	void YCSBA(ThreadState* thread);
-	void YCSBB(ThreadState* thread);
-	void YCSBC(ThreadState* thread);
-	void YCSBD(ThreadState* thread);
-	void YCSBE(ThreadState* thread);
+	void runSpec(ThreadState* thread, const WorkloadSpec &spec);
+	void runVirtualClients(ThreadState* thread, const WorkloadSpec &spec);
+	void doOp(ThreadState* thread, SpecContext &ctx, SpecOp op, FastRandom &rng);
+	void massDelete(ThreadState* thread, const WorkloadSpec &spec);
+	void runReplay(ThreadState* thread, const WorkloadSpec &spec);
 };
 
 #endif // BENCHMARK_H
@@ -0,0 +1,242 @@
+#include "distribution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+// ----------
+// Fixed, Uniform and Normal
+// ----------
+
+uint64_t FixedDistribution::Sample(FastRandom &rng) {
+    return value_;
+}
+
+uint64_t UniformDistribution::Sample(FastRandom &rng) {
+    return dist_(rng);
+}
+
+uint64_t SequentialDistribution::Sample(FastRandom &rng) {
+    uint64_t value = next_;
+    next_ = value == max_ ? min_ : value + 1;
+    return value;
+}
+
+NormalDistribution::NormalDistribution(uint64_t min, uint64_t max)
+    : dist_((static_cast<double>(min) + max) / 2.0, (static_cast<double>(max) - min) / 6.0), // 99.7% of values within [min, max]
+      min_(min), max_(max) {}
+
+uint64_t NormalDistribution::Sample(FastRandom &rng) {
+    double val = std::round(dist_(rng));
+    if (val <= static_cast<double>(min_)) {
+        return min_;
+    }
+    return std::min(max_, static_cast<uint64_t>(val));
+}
+
+// ----------
+// Zipfian, by rejection-inversion sampling
+// ----------
+
+// log1p(x)/x and expm1(x)/x, continued to 1 at x = 0.
+static double helper1(double x) {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static double helper2(double x) {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+ZipfianDistribution::ZipfianDistribution(uint64_t min, uint64_t max, double s)
+    : min_(min), n_(max - min + 1) {
+    setExponent(s);
+}
+
+void ZipfianDistribution::setMax(uint64_t max) {
+    n_ = max - min_ + 1;
+    hIntegralN_ = H(static_cast<double>(n_) + 0.5);
+}
+
+void ZipfianDistribution::setExponent(double s) {
+    s_ = s;
+    hIntegralX1_ = H(1.5) - 1.0;
+    threshold_ = 2.0 - HInverse(H(2.5) - h(2.0));
+    hIntegralN_ = H(static_cast<double>(n_) + 0.5);
+}
+
+// h(x) = 1/x^s, the unnormalized weight of rank x.
+double ZipfianDistribution::h(double x) const {
+    return std::exp(-s_ * std::log(x));
+}
+
+// H is an antiderivative of h, and HInverse its inverse.
+double ZipfianDistribution::H(double x) const {
+    double logX = std::log(x);
+    return helper2((1.0 - s_) * logX) * logX;
+}
+
+double ZipfianDistribution::HInverse(double x) const {
+    double t = std::max(-1.0, x * (1.0 - s_));
+    return std::exp(helper1(t) * x);
+}
+
+uint64_t ZipfianDistribution::Sample(FastRandom &rng) {
+    while (true) {
+        double u = hIntegralN_ + uniDist_(rng) * (hIntegralX1_ - hIntegralN_);
+        double x = HInverse(u);
+        double k = std::floor(x + 0.5);
+        if (k < 1) {
+            k = 1;
+        } else if (k > static_cast<double>(n_)) {
+            k = static_cast<double>(n_);
+        }
+        if (k - x <= threshold_ || u >= H(k + 0.5) - h(k)) {
+            return min_ + static_cast<uint64_t>(k) - 1;
+        }
+    }
+}
+
+// ----------
+// Latest
+// ----------
+
+LatestDistribution::LatestDistribution(const std::atomic<uint64_t> *frontier, double s)
+    : frontier_(frontier), n_(0), offsets_(0, 0, s) {}
+
+uint64_t LatestDistribution::Sample(FastRandom &rng) {
+    uint64_t n = frontier_->load(std::memory_order_relaxed);
+    if (n == 0) {
+        return 0;
+    }
+    if (n != n_) {
+        offsets_.setMax(n - 1);
+        n_ = n;
+    }
+    return n - 1 - offsets_.Generate(rng);
+}
+
+// ----------
+// Hotspot
+// ----------
+
+HotspotDistribution::HotspotDistribution(uint64_t min, uint64_t max, double hotSetFraction,
+                                         double hotOpFraction, double shiftRate)
+    : min_(min), n_(max - min + 1), hotOpFraction_(hotOpFraction), shiftRate_(shiftRate),
+      start_(std::chrono::steady_clock::now()) {
+    hotSize_ = static_cast<uint64_t>(static_cast<double>(n_) * hotSetFraction);
+    hotSize_ = std::max<uint64_t>(1, std::min(hotSize_, n_));
+}
+
+uint64_t HotspotDistribution::Sample(FastRandom &rng) {
+    uint64_t offset;
+    if (hotSize_ == n_ || uniDist_(rng) < hotOpFraction_) {
+        offset = rng() % hotSize_;
+    } else {
+        offset = hotSize_ + rng() % (n_ - hotSize_);
+    }
+    if (shiftRate_ > 0) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        double shift = std::fmod(seconds * shiftRate_, 1.0) * static_cast<double>(n_);
+        offset = (offset + static_cast<uint64_t>(shift)) % n_;
+    }
+    return min_ + offset;
+}
+
+// ----------
+// Drifting Zipfian
+// ----------
+
+DriftingZipfianDistribution::DriftingZipfianDistribution(uint64_t min, uint64_t max, double sStart,
+                                                         double sEnd, double driftSeconds)
+    : zipf_(min, max, sStart), sStart_(sStart), sEnd_(sEnd), driftSeconds_(driftSeconds),
+      samples_(0), start_(std::chrono::steady_clock::now()) {}
+
+uint64_t DriftingZipfianDistribution::Sample(FastRandom &rng) {
+    // Re-deriving the exponent costs a few transcendental calls, so only do
+    // it every 1024 samples.
+    if ((samples_++ & 1023) == 0 && driftSeconds_ > 0) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        double progress = std::min(1.0, seconds / driftSeconds_);
+        zipf_.setExponent(sStart_ + (sEnd_ - sStart_) * progress);
+    }
+    return zipf_.Generate(rng);
+}
+
+// ----------
+// Pareto
+// ----------
+
+ParetoDistribution::ParetoDistribution(uint64_t min, uint64_t max, double scale, double shape)
+    : min_(min), max_(max), scale_(scale), shape_(shape) {}
+
+uint64_t ParetoDistribution::Sample(FastRandom &rng) {
+    // Inverse of the CDF, with u in (0, 1].
+    double u = 1.0 - uniDist_(rng);
+    double x = shape_ == 0 ? -scale_ * std::log(u) : scale_ * std::expm1(-shape_ * std::log(u)) / shape_;
+    x = std::round(x);
+    if (x >= static_cast<double>(max_ - min_)) {
+        return max_;
+    }
+    return min_ + static_cast<uint64_t>(x);
+}
+
+// ----------
+// Empirical
+// ----------
+
+Result loadHistogram(const std::string &path, std::vector<HistogramBucket> &buckets) {
+    std::ifstream in(path);
+    if (!in) {
+        return Result::Error("Cannot open histogram file " + path);
+    }
+    buckets.clear();
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::vector<double> values;
+        double v;
+        while (fields >> v) {
+            values.push_back(v);
+        }
+        if (!fields.eof() || (values.size() != 2 && values.size() != 3)) {
+            return Result::Error(path + ":" + std::to_string(lineNo) + ": expected <size> <weight> or <min> <max> <weight>");
+        }
+        HistogramBucket bucket;
+        bucket.min = static_cast<uint64_t>(values[0]);
+        bucket.max = static_cast<uint64_t>(values[values.size() - 2]);
+        bucket.weight = values.back();
+        if (values[0] < 0 || bucket.max < bucket.min || bucket.weight < 0) {
+            return Result::Error(path + ":" + std::to_string(lineNo) + ": invalid bucket");
+        }
+        if (bucket.weight > 0) {
+            buckets.push_back(bucket);
+        }
+    }
+    if (buckets.empty()) {
+        return Result::Error("Histogram file " + path + " has no buckets with a positive weight");
+    }
+    return Result::OK();
+}
+
+EmpiricalDistribution::EmpiricalDistribution(std::vector<HistogramBucket> buckets)
+    : buckets_(std::move(buckets)) {
+    double total = 0;
+    for (const auto &bucket : buckets_) {
+        total += bucket.weight;
+        cumulative_.push_back(total);
+    }
+}
+
+uint64_t EmpiricalDistribution::Sample(FastRandom &rng) {
+    double u = uniDist_(rng) * cumulative_.back();
+    size_t i = std::upper_bound(cumulative_.begin(), cumulative_.end(), u) - cumulative_.begin();
+    const HistogramBucket &bucket = buckets_[std::min(i, buckets_.size() - 1)];
+    return bucket.min + rng() % (bucket.max - bucket.min + 1);
+}
@@ -0,0 +1,253 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "result.h"
+
+// Define the types of distributions you want.
+enum class DistributionType {
+    Fixed,
+    Uniform,
+    Normal,
+    Zipfian,
+    Latest,
+    Hotspot,
+    ShiftingHotspot,
+    DriftingZipfian,
+    Pareto,
+    Empirical,
+    Sequential
+};
+
+// FastRandom is a SplitMix64 generator usable with the <random> distributions.
+// Its state is a single word, so thousands of virtual clients can each own one.
+class FastRandom {
+public:
+    using result_type = uint64_t;
+
+    explicit FastRandom(uint64_t seed = std::random_device{}()) : state_(seed) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Base class for a distribution over 64-bit integers. The random state can be
+// supplied by the caller, so that one distribution can serve many independent
+// clients. No distribution allocates memory proportional to its range, so
+// they all work for keyspaces of billions of records.
+class BaseDistribution {
+public:
+    virtual ~BaseDistribution() = default;
+    uint64_t Generate() {
+        return Sample(gen_);
+    }
+    uint64_t Generate(FastRandom &rng) {
+        return Sample(rng);
+    }
+protected:
+    virtual uint64_t Sample(FastRandom &rng) = 0;
+private:
+    FastRandom gen_;
+};
+
+// Fixed distribution always returns the same value.
+class FixedDistribution : public BaseDistribution {
+public:
+    FixedDistribution(uint64_t value) : value_(value) {}
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+private:
+    uint64_t value_;
+};
+
+// Uniform distribution returns a random value between min and max.
+class UniformDistribution : public BaseDistribution {
+public:
+    UniformDistribution(uint64_t min, uint64_t max) : dist_(min, max) {}
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+private:
+    std::uniform_int_distribution<uint64_t> dist_;
+};
+
+// Sequential distribution returns min, min + 1, ... up to max, then wraps.
+class SequentialDistribution : public BaseDistribution {
+public:
+    SequentialDistribution(uint64_t min, uint64_t max) : min_(min), max_(max), next_(min) {}
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+private:
+    uint64_t min_;
+    uint64_t max_;
+    uint64_t next_;
+};
+
+// Normal distribution returns a value centered around the average with a given stddev.
+// The result is clamped to the [min, max] range.
+class NormalDistribution : public BaseDistribution {
+public:
+    NormalDistribution(uint64_t min, uint64_t max);
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+private:
+    std::normal_distribution<double> dist_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+// ZipfianDistribution generates integers in [min, max] following a Zipfian
+// (power-law) distribution: min is the most popular value, min + k - 1 has
+// weight 1/k^s. Values are drawn by rejection-inversion (Hörmann and
+// Derflinger), which needs O(1) memory and setup for any range size.
+class ZipfianDistribution : public BaseDistribution {
+public:
+    // min: lower bound (inclusive)
+    // max: upper bound (inclusive)
+    // s: exponent parameter, > 0
+    ZipfianDistribution(uint64_t min, uint64_t max, double s = 1.2);
+
+    // Moves the upper bound or changes the exponent; both are cheap enough
+    // to call between samples.
+    void setMax(uint64_t max);
+    void setExponent(double s);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    double h(double x) const;
+    double H(double x) const;
+    double HInverse(double x) const;
+
+    uint64_t min_;
+    uint64_t n_;          // number of values in the range
+    double s_;
+    double hIntegralX1_;
+    double hIntegralN_;
+    double threshold_;
+    std::uniform_real_distribution<double> uniDist_{0.0, 1.0};
+};
+
+// In this distribution, the latest values are the most popular: it follows
+// a Zipfian distribution anchored at the insert frontier, the next key to be
+// inserted, so that keys inserted while the workload runs become the hottest.
+class LatestDistribution : public BaseDistribution {
+public:
+    // frontier: shared counter of inserted keys; samples fall in [0, *frontier)
+    // s: Zipfian exponent of the distance to the frontier
+    LatestDistribution(const std::atomic<uint64_t> *frontier, double s = 1.2);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    const std::atomic<uint64_t> *frontier_;
+    uint64_t n_;   // frontier the offsets below were sized for
+    ZipfianDistribution offsets_;
+};
+
+// HotspotDistribution sends hotOpFraction of the samples uniformly to a hot
+// set covering hotSetFraction of [min, max], and the rest uniformly to the
+// other keys. The hot set can move: every second it shifts by shiftRate of
+// the range, wrapping around, so the keys that are hot keep changing.
+class HotspotDistribution : public BaseDistribution {
+public:
+    HotspotDistribution(uint64_t min, uint64_t max, double hotSetFraction,
+                        double hotOpFraction, double shiftRate = 0.0);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    uint64_t min_;
+    uint64_t n_;
+    uint64_t hotSize_;
+    double hotOpFraction_;
+    double shiftRate_;
+    std::chrono::steady_clock::time_point start_;
+    std::uniform_real_distribution<double> uniDist_{0.0, 1.0};
+};
+
+// DriftingZipfianDistribution is a Zipfian distribution whose exponent moves
+// linearly from sStart to sEnd over driftSeconds, then stays at sEnd.
+class DriftingZipfianDistribution : public BaseDistribution {
+public:
+    DriftingZipfianDistribution(uint64_t min, uint64_t max, double sStart,
+                                double sEnd, double driftSeconds);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    ZipfianDistribution zipf_;
+    double sStart_;
+    double sEnd_;
+    double driftSeconds_;
+    uint64_t samples_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// ParetoDistribution draws from a generalized Pareto distribution with
+// location min, clamped to max. Facebook's ETC memcached pool has value sizes
+// following scale 214.476 and shape 0.348238 (Atikoglu et al., SIGMETRICS'12).
+class ParetoDistribution : public BaseDistribution {
+public:
+    // scale: > 0
+    // shape: 0 gives an exponential tail, larger values a heavier one
+    ParetoDistribution(uint64_t min, uint64_t max, double scale, double shape);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    uint64_t min_;
+    uint64_t max_;
+    double scale_;
+    double shape_;
+    std::uniform_real_distribution<double> uniDist_{0.0, 1.0};
+};
+
+// One bucket of an empirical histogram: values in [min, max], drawn with
+// probability proportional to weight.
+struct HistogramBucket {
+    uint64_t min;
+    uint64_t max;
+    double weight;
+};
+
+// Reads a histogram file. Each line holds "<size> <weight>" or
+// "<min> <max> <weight>"; blank lines and lines starting with # are skipped.
+Result loadHistogram(const std::string &path, std::vector<HistogramBucket> &buckets);
+
+// EmpiricalDistribution picks a bucket by weight, then a value uniformly
+// within it.
+class EmpiricalDistribution : public BaseDistribution {
+public:
+    explicit EmpiricalDistribution(std::vector<HistogramBucket> buckets);
+
+protected:
+    uint64_t Sample(FastRandom &rng) override;
+
+private:
+    std::vector<HistogramBucket> buckets_;
+    std::vector<double> cumulative_;   // running sum of the bucket weights
+    std::uniform_real_distribution<double> uniDist_{0.0, 1.0};
+};
+
+#endif // DISTRIBUTION_H
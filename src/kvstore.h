@@ -4,18 +4,77 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <memory>
 
 #include "result.h"
 #include "options.h"
 
-class KVStore {
+// How an adapter may be used by the benchmark's worker threads.
+enum class ThreadSafety {
+    Shared,      // one instance is safe to use from all threads at once
+    PerThread,   // every thread must go through its own session
+    Serialized   // not thread-safe at all; the harness serializes every op
+};
+
+// The operations a worker thread issues. A KVStore is itself a session, so
+// thread-safe adapters are used directly without any indirection.
+class KVSession {
 public:
-	virtual ~KVStore() = default;
-    virtual Result init(std::map<std::string, std::string> options) = 0;
+	virtual ~KVSession() = default;
     virtual Result put(const std::string &key, const std::string &value) = 0;
     virtual Result get(const std::string &key) = 0;
+    // Reads a key and hands its value back, for --verify. Adapters that keep
+    // this default return no data, and their reads go unverified.
+    virtual Result getValue(const std::string &key, std::string *value) {
+        value->clear();
+        return get(key);
+    }
     virtual Result remove(const std::string &key) = 0;
     virtual Result scan(const std::string &start, const std::string &end) = 0;
 };
 
+class KVStore : public KVSession {
+public:
+	virtual ~KVStore() = default;
+    virtual Result init(std::map<std::string, std::string> options) = 0;
+
+    virtual ThreadSafety threadSafety() const { return ThreadSafety::Shared; }
+
+    // Where the store keeps its files, for measuring its size on disk.
+    // Stores without a directory of their own return an empty path. Before
+    // init, it is the directory the store would use by default, or empty if
+    // that depends on its options.
+    virtual std::string dataDirectory() const { return ""; }
+    // The directory init would use with these options, asked before init.
+    // Stores whose default does not depend on their options keep this one;
+    // stores built over another adapter ask theirs.
+    virtual std::string defaultDataDirectory(const std::map<std::string, std::string> &options) const {
+        return dataDirectory();
+    }
+    // Asks the store to open the data a previous run left rather than start
+    // empty (--use_existing). Called before init; stores that cannot keep
+    // data from one run to the next keep this default, which refuses.
+    virtual Result reuseData() {
+        return Result::Error("Adapter cannot reuse the data of a previous run");
+    }
+    // Whether init started from an empty store, dropping any data a previous
+    // run left; a dataset manifest then no longer describes the store.
+    virtual bool startedFresh() const { return true; }
+    // What the store saw since it was last asked, as indented report lines,
+    // printed with the results of the workload step that just ended. Asked
+    // once the step's sessions are closed; stores with nothing of their own
+    // to report keep this default.
+    virtual std::string takeStepReport() { return ""; }
+    // Finishes the work a store defers after writes (flushes, compactions),
+    // so that its footprint can be measured at rest. Stores with nothing
+    // deferred keep this default.
+    virtual Result quiesce() { return Result::OK(); }
+
+    // Opens a session (connection, handle, ...) for a single worker thread.
+    // Called from that thread, only when threadSafety() is PerThread.
+    virtual Result openSession(std::unique_ptr<KVSession> &session) {
+        return Result::Error("Adapter does not support sessions");
+    }
+};
+
 #endif // KVSTORE_H
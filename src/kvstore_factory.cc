@@ -1,4 +1,5 @@
 #include "kvstore_factory.h"
+#include "plugin_loader.h"
 #include <stdexcept>
 
 // Returns a reference to the single global instance of KVStoreFactory.
@@ -8,19 +9,62 @@ KVStoreFactory& KVStoreFactory::instance() {
     return instance;
 }
 
+void KVStoreFactory::setPluginPath(const std::string& path) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    pluginPath_ = path;
+}
+
+std::string KVStoreFactory::pluginPath() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return pluginPath_;
+}
+
 // Registers a new adapter creation function under the specified name.
 void KVStoreFactory::registerAdapter(const std::string& name, CreatorFunc creator) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     registry[name] = creator;
 }
 
-// Creates an adapter instance by looking up the provided name in the registry.
+bool KVStoreFactory::hasAdapter(const std::string& name) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return registry.find(name) != registry.end();
+}
+
+// Creates an adapter instance by looking up the provided name in the registry,
+// loading its plugin from the plugin path first if needed.
 // If the adapter is not found, this function throws a runtime_error.
-std::unique_ptr<KVStore> KVStoreFactory::create(const std::string& name) const {
-    auto it = registry.find(name);
-    if (it != registry.end()) {
-        // Call the creator function to instantiate the adapter.
-        return (it->second)();
-    } else {
-        throw std::runtime_error("Adapter not found: " + name);
+std::unique_ptr<KVStore> KVStoreFactory::create(const std::string& name) {
+    CreatorFunc creator;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        auto it = registry.find(name);
+        if (it == registry.end()) {
+            auto r = loadPlugin(*this, name, pluginPath_, nullptr);
+            if (!r.ok()) {
+                throw std::runtime_error("Adapter not found: " + name + " (" + r.message() + ")");
+            }
+            it = registry.find(name);
+        }
+        creator = it->second;
+    }
+    // Call the creator function to instantiate the adapter.
+    return creator();
+}
+
+std::map<std::string, std::string> forwardedOptions(const std::string& backend,
+                                                    const std::map<std::string, std::string>& options) {
+    std::string prefix = backend + "-";
+    std::map<std::string, std::string> forwarded;
+    for (const auto& option : options) {
+        if (option.first.compare(0, prefix.size(), prefix) == 0) {
+            forwarded[option.first.substr(prefix.size())] = option.second;
+        }
+    }
+    // insert keeps a prefixed option already there
+    for (const auto& option : options) {
+        if (option.first.compare(0, prefix.size(), prefix) != 0) {
+            forwarded.insert(option);
+        }
     }
+    return forwarded;
 }
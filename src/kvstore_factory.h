@@ -4,6 +4,7 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "kvstore.h"
@@ -14,12 +15,28 @@ public:
 
     static KVStoreFactory& instance();
 
+    // Directories searched when an adapter that is not registered yet is
+    // created, ':'-separated.
+    void setPluginPath(const std::string& path);
+    std::string pluginPath() const;
+
     void registerAdapter(const std::string& name, CreatorFunc creator);
-    std::unique_ptr<KVStore> create(const std::string& name) const;
+    bool hasAdapter(const std::string& name) const;
+    std::unique_ptr<KVStore> create(const std::string& name);
 
 private:
     KVStoreFactory() = default;
     std::map<std::string, CreatorFunc> registry;
+    std::string pluginPath_ = "./adapters";
+    mutable std::recursive_mutex mutex_;
 };
 
+// The options an adapter built over another one (cache, delay, shard) passes
+// on to its backend: the ones it did not consume, with "<backend>-" taken off
+// those that carry it. Such prefixed options win over unprefixed ones, so
+// that stacked adapters can tell their options apart, e.g.
+// --cache-backend=delay --cache-delay-backend=logstore --cache-delay-logstore-dir=/data.
+std::map<std::string, std::string> forwardedOptions(const std::string& backend,
+                                                    const std::map<std::string, std::string>& options);
+
 #endif // KVSTORE_FACTORY_H
@@ -0,0 +1,88 @@
+#include "latency_log.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kMagic[8] = {'M', 'K', 'V', 'L', 'A', 'T', '0', '1'};
+
+LatencyLog::~LatencyLog() {
+    if (map_) {
+        munmap(map_, mapSize_);
+    }
+}
+
+Result LatencyLog::open(const std::string& path, uint64_t capacity, int thread, const std::string& workload) {
+    if (capacity == 0) {
+        return Result::Error("A latency log needs room for at least one op");
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return Result::Error("Cannot open latency log " + path);
+    }
+    mapSize_ = sizeof(LatencyLogHeader) + capacity * sizeof(LatencyRecord);
+    if (ftruncate(fd, static_cast<off_t>(mapSize_)) != 0) {
+        ::close(fd);
+        return Result::Error("Cannot size latency log " + path);
+    }
+    // MAP_POPULATE faults the pages in now rather than during measured ops
+    map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        return Result::Error("Cannot map latency log " + path);
+    }
+    header_ = static_cast<LatencyLogHeader*>(map_);
+    records_ = reinterpret_cast<LatencyRecord*>(header_ + 1);
+    memcpy(header_->magic, kMagic, sizeof(kMagic));
+    header_->capacity = capacity;
+    header_->count = 0;
+    header_->thread = thread;
+    strncpy(header_->workload, workload.c_str(), sizeof(header_->workload) - 1);
+    return Result::OK();
+}
+
+LatencyLogReader::~LatencyLogReader() {
+    if (map_) {
+        munmap(map_, mapSize_);
+    }
+}
+
+Result LatencyLogReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Result::Error("Cannot open latency log " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(LatencyLogHeader))) {
+        ::close(fd);
+        return Result::Error("Not a latency log: " + path);
+    }
+    mapSize_ = static_cast<size_t>(st.st_size);
+    map_ = mmap(nullptr, mapSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        return Result::Error("Cannot map latency log " + path);
+    }
+    header_ = static_cast<const LatencyLogHeader*>(map_);
+    records_ = reinterpret_cast<const LatencyRecord*>(header_ + 1);
+    if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 || header_->capacity == 0 ||
+        header_->capacity > (mapSize_ - sizeof(LatencyLogHeader)) / sizeof(LatencyRecord)) {
+        return Result::Error("Not a latency log: " + path);
+    }
+    return Result::OK();
+}
+
+uint64_t LatencyLogReader::size() const {
+    return header_->count < header_->capacity ? header_->count : header_->capacity;
+}
+
+const LatencyRecord& LatencyLogReader::record(uint64_t i) const {
+    // a ring that wrapped starts after its newest record
+    uint64_t first = header_->count < header_->capacity ? 0 : header_->count % header_->capacity;
+    return records_[(first + i) % header_->capacity];
+}
@@ -0,0 +1,83 @@
+#ifndef LATENCY_LOG_H
+#define LATENCY_LOG_H
+
+#include <cstdint>
+#include <string>
+
+#include "result.h"
+
+// One op of a latency log: when it started and how long it took, on the
+// steady clock, and its OperationType.
+struct LatencyRecord {
+    uint64_t startNanos;
+    uint64_t latencyAndType;   // latency in ns << 8 | op type
+
+    uint64_t latencyNanos() const { return latencyAndType >> 8; }
+    int opType() const { return static_cast<int>(latencyAndType & 0xff); }
+};
+
+// The header at the start of a latency log file.
+struct LatencyLogHeader {
+    char magic[8];
+    uint64_t capacity;   // records the ring holds
+    uint64_t count;      // records appended; past capacity, only the last ones are kept
+    int32_t thread;
+    uint32_t reserved;
+    char workload[64];   // name of the results the thread reported into
+};
+
+//
+// LatencyLog: a per-thread log of every op's start and latency (--latency_log),
+// for finding when slow ops happened. The file is sized and mapped up front,
+// with its pages faulted in before the thread starts measuring, so appending
+// is two stores and no system call. It is a ring: once full, the oldest ops
+// are overwritten. tools/latency_report merges the logs of a run.
+//
+class LatencyLog {
+public:
+    LatencyLog() = default;
+    ~LatencyLog();
+
+    Result open(const std::string& path, uint64_t capacity, int thread, const std::string& workload);
+
+    void append(uint64_t startNanos, uint64_t latencyNanos, int opType) {
+        records_[header_->count % header_->capacity] = LatencyRecord{startNanos, latencyNanos << 8 | opType};
+        header_->count++;
+    }
+    // Drops the ops appended so far.
+    void reset() { header_->count = 0; }
+
+    LatencyLog(const LatencyLog&) = delete;
+    LatencyLog& operator=(const LatencyLog&) = delete;
+
+private:
+    void* map_ = nullptr;
+    size_t mapSize_ = 0;
+    LatencyLogHeader* header_ = nullptr;
+    LatencyRecord* records_ = nullptr;
+};
+
+// Maps a latency log for reading.
+class LatencyLogReader {
+public:
+    LatencyLogReader() = default;
+    ~LatencyLogReader();
+
+    Result open(const std::string& path);
+
+    const LatencyLogHeader& header() const { return *header_; }
+    // Records kept, oldest first.
+    uint64_t size() const;
+    const LatencyRecord& record(uint64_t i) const;
+
+    LatencyLogReader(const LatencyLogReader&) = delete;
+    LatencyLogReader& operator=(const LatencyLogReader&) = delete;
+
+private:
+    void* map_ = nullptr;
+    size_t mapSize_ = 0;
+    const LatencyLogHeader* header_ = nullptr;
+    const LatencyRecord* records_ = nullptr;
+};
+
+#endif // LATENCY_LOG_H
@@ -1,10 +1,10 @@
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include "kvstore_factory.h"
 #include "options.h"
 #include "benchmark.h"
-// Remove the static include of rocksdb_adapter.h if it is now in the plugin.
-
-extern void loadPlugins(KVStoreFactory&, const std::string&); // Declaration from plugin_loader.cc
+#include "plugin_loader.h"
 
 int main(int argc, char *argv[])
 {
@@ -16,8 +16,19 @@ int main(int argc, char *argv[])
     }
 
     KVStoreFactory& factory = KVStoreFactory::instance();
-    // Load all plugins from a specified directory (e.g., "./adapters")
-    loadPlugins(factory, "./adapters");
+    factory.setPluginPath(options.pluginPath);
+
+    // Load only the plugin providing the selected adapter, and time it.
+    auto loadStart = std::chrono::steady_clock::now();
+    std::string pluginFile;
+    r = loadPlugin(factory, options.adapter, options.pluginPath, &pluginFile);
+    if (!r.ok()) {
+        std::cerr << "Error: " << r.message() << std::endl;
+        return 1;
+    }
+    double loadMillis = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - loadStart).count();
+    printf("Loaded adapter %s from %s in %.3f ms\n", options.adapter.c_str(), pluginFile.c_str(), loadMillis);
 
     std::unique_ptr<KVStore> kv = factory.create(options.adapter);
     Benchmark benchmark;
@@ -0,0 +1,101 @@
+#include "manifest.h"
+
+#include <cstdio>
+#include <fstream>
+
+const char* const kPaddedDecimalKeys = "padded_decimal";
+
+// Adapter options are kept as adapter.<option>=<value>.
+static const std::string kAdapterOptionPrefix = "adapter.";
+
+Result writeManifest(const std::string& path, const DatasetManifest& manifest) {
+    // write a new file and rename it, so that a crash never leaves half a manifest
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    if (!out) {
+        return Result::Error("Cannot write dataset manifest " + path);
+    }
+    out << "# dataset loaded by marccsman; reuse it with --use_existing=true\n";
+    out << "adapter=" << manifest.adapter << "\n";
+    for (const auto& option : manifest.adapterOptions) {
+        out << kAdapterOptionPrefix << option.first << "=" << option.second << "\n";
+    }
+    out << "loaded_by=" << manifest.loadedBy << "\n";
+    out << "records=" << manifest.records << "\n";
+    out << "sparse=" << (manifest.sparse ? "true" : "false") << "\n";
+    out << "key_size=" << manifest.keySize << "\n";
+    out << "key_format=" << manifest.keyFormat << "\n";
+    out << "seed=" << manifest.seed << "\n";
+    out << "value_distribution=" << manifest.valueDistribution << "\n";
+    out << "value_size=" << manifest.valueSize << "\n";
+    out << "value_size_min=" << manifest.valueSizeMin << "\n";
+    out << "value_size_max=" << manifest.valueSizeMax << "\n";
+    out << "insert_frontier=" << manifest.insertFrontier << "\n";
+    out << "delete_frontier=" << manifest.deleteFrontier << "\n";
+    out << "verify=" << (manifest.verify ? "true" : "false") << "\n";
+    out.close();
+    if (!out || rename(tmp.c_str(), path.c_str()) != 0) {
+        return Result::Error("Cannot write dataset manifest " + path);
+    }
+    return Result::OK();
+}
+
+Result readManifest(const std::string& path, DatasetManifest& manifest) {
+    std::ifstream in(path);
+    if (!in) {
+        return Result::Error("No dataset manifest at " + path + "; load the dataset first");
+    }
+    manifest = DatasetManifest();
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            return Result::Error(path + ":" + std::to_string(lineNo) + ": expected property=value");
+        }
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        try {
+            if (key.compare(0, kAdapterOptionPrefix.size(), kAdapterOptionPrefix) == 0) {
+                manifest.adapterOptions[key.substr(kAdapterOptionPrefix.size())] = value;
+            } else if (key == "adapter") {
+                manifest.adapter = value;
+            } else if (key == "loaded_by") {
+                manifest.loadedBy = value;
+            } else if (key == "records") {
+                manifest.records = std::stoull(value);
+            } else if (key == "sparse") {
+                manifest.sparse = value == "true";
+            } else if (key == "key_size") {
+                manifest.keySize = std::stoi(value);
+            } else if (key == "key_format") {
+                manifest.keyFormat = value;
+            } else if (key == "seed") {
+                manifest.seed = std::stoull(value);
+            } else if (key == "value_distribution") {
+                manifest.valueDistribution = value;
+            } else if (key == "value_size") {
+                manifest.valueSize = std::stoi(value);
+            } else if (key == "value_size_min") {
+                manifest.valueSizeMin = std::stoi(value);
+            } else if (key == "value_size_max") {
+                manifest.valueSizeMax = std::stoi(value);
+            } else if (key == "insert_frontier") {
+                manifest.insertFrontier = std::stoull(value);
+            } else if (key == "delete_frontier") {
+                manifest.deleteFrontier = std::stoull(value);
+            } else if (key == "verify") {
+                manifest.verify = value == "true";
+            } else {
+                return Result::Error(path + ":" + std::to_string(lineNo) + ": unknown property " + key);
+            }
+        } catch (const std::exception&) {
+            return Result::Error(path + ":" + std::to_string(lineNo) + ": invalid value for " + key);
+        }
+    }
+    return Result::OK();
+}
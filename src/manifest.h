@@ -0,0 +1,41 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "result.h"
+
+//
+// DatasetManifest: describes the dataset a run left in the store, so that a
+// later run can reuse it (--use_existing) instead of loading it again. It is
+// written after every load step and at the end of a run that had one, as
+// "property=value" lines.
+//
+struct DatasetManifest {
+    std::string adapter;
+    std::map<std::string, std::string> adapterOptions;
+    std::string loadedBy;            // the load steps, comma-separated
+    uint64_t records = 0;            // the load wrote keys of [0, records)
+    bool sparse = false;             // the load drew keys at random, so some of them are missing
+    int keySize = 0;
+    std::string keyFormat;           // how key numbers are turned into keys
+    uint64_t seed = 0;               // 0 if the load was not seeded
+    std::string valueDistribution;
+    int valueSize = 0;
+    int valueSizeMin = 0;
+    int valueSizeMax = 0;
+    uint64_t insertFrontier = 0;     // next key number an insert writes
+    uint64_t deleteFrontier = 0;     // keys below it were deleted oldest first
+    bool verify = false;             // every value carries a --verify stamp
+};
+
+// The key format the harness writes: the key number in decimal, left-padded
+// with zeros to the key size.
+extern const char* const kPaddedDecimalKeys;
+
+Result writeManifest(const std::string& path, const DatasetManifest& manifest);
+Result readManifest(const std::string& path, DatasetManifest& manifest);
+
+#endif // MANIFEST_H
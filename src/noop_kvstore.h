@@ -0,0 +1,21 @@
+#ifndef NOOP_KVSTORE_H
+#define NOOP_KVSTORE_H
+
+#include <map>
+#include <string>
+
+#include "kvstore.h"
+
+// NoopKVStore accepts every operation and does nothing, so a workload run
+// against it measures the harness alone: key and value generation, status
+// handling and stats recording.
+class NoopKVStore : public KVStore {
+public:
+    Result init(std::map<std::string, std::string> options) override { return Result::OK(); }
+    Result put(const std::string &key, const std::string &value) override { return Result::OK(); }
+    Result get(const std::string &key) override { return Result::OK(); }
+    Result remove(const std::string &key) override { return Result::OK(); }
+    Result scan(const std::string &start, const std::string &end) override { return Result::OK(); }
+};
+
+#endif // NOOP_KVSTORE_H
@@ -0,0 +1,204 @@
+#include "op_trace.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kMagic[8] = {'M', 'K', 'V', 'T', 'R', 'C', '0', '2'};
+// Traces from before clock records; they read the same.
+static const char kMagicV1[8] = {'M', 'K', 'V', 'T', 'R', 'C', '0', '1'};
+
+// Opens a chunk; not a TraceOp.
+static const uint8_t kClockRecord = 0xff;
+
+// A thread hands its records to the file once this many bytes are buffered.
+static const size_t kChunkBytes = 64 << 10;
+
+uint64_t OpTraceWriter::nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putVarint(char*& p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+}
+
+OpTraceWriter::~OpTraceWriter() {
+    close();
+}
+
+Result OpTraceWriter::open(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        return Result::Error("Cannot open op trace " + path);
+    }
+    path_ = path;
+    startMicros_ = nowMicros();
+    // a large buffer, so that appending seldom calls into the kernel under the lock
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    fwrite(kMagic, 1, sizeof(kMagic), file_);
+    return Result::OK();
+}
+
+Result OpTraceWriter::close() {
+    if (!file_) {
+        return Result::OK();
+    }
+    bool failed = ferror(file_) != 0;
+    failed |= fclose(file_) != 0;
+    file_ = nullptr;
+    if (failed) {
+        return Result::Error("Cannot write op trace " + path_);
+    }
+    return Result::OK();
+}
+
+void OpTraceWriter::append(const std::string& chunk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fwrite(chunk.data(), 1, chunk.size(), file_);
+}
+
+OpTraceBuffer::~OpTraceBuffer() {
+    flush();
+}
+
+void OpTraceBuffer::append(TraceOp op, const std::string& key, uint64_t valueSize, const std::string* endKey) {
+    uint64_t now = OpTraceWriter::nowMicros();
+    // a clock record, op, three varints and the keys
+    size_t endKeySize = endKey ? endKey->size() : 0;
+    size_t used = chunk_.size();
+    chunk_.resize(used + 11 + 1 + 3 * 10 + key.size() + endKeySize);
+    char* p = &chunk_[used];
+    if (used == 0) {
+        *p++ = static_cast<char>(kClockRecord);
+        putVarint(p, now - writer_->startMicros());
+        lastMicros_ = now;
+    }
+    *p++ = static_cast<char>(op);
+    putVarint(p, now - lastMicros_);
+    lastMicros_ = now;
+    putVarint(p, key.size());
+    memcpy(p, key.data(), key.size());
+    p += key.size();
+    if (op == TraceOp::Put) {
+        putVarint(p, valueSize);
+    } else if (op == TraceOp::Scan) {
+        putVarint(p, endKeySize);
+        if (endKeySize > 0) {
+            memcpy(p, endKey->data(), endKeySize);
+            p += endKeySize;
+        }
+    }
+    chunk_.resize(p - chunk_.data());
+    if (chunk_.size() >= kChunkBytes) {
+        flush();
+    }
+}
+
+void OpTraceBuffer::flush() {
+    if (!chunk_.empty()) {
+        writer_->append(chunk_);
+        chunk_.clear();
+    }
+}
+
+OpTraceReader::~OpTraceReader() {
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+Result OpTraceReader::open(const std::string& path) {
+    path_ = path;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Result::Error("Cannot open op trace " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(kMagic))) {
+        ::close(fd);
+        return Result::Error("Not an op trace: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return Result::Error("Cannot map op trace " + path);
+    }
+    data_ = static_cast<const char*>(data);
+    // read ahead, and let the kernel drop the pages already replayed
+    madvise(data, size_, MADV_SEQUENTIAL);
+    if (memcmp(data_, kMagic, sizeof(kMagic)) != 0 && memcmp(data_, kMagicV1, sizeof(kMagicV1)) != 0) {
+        return Result::Error("Not an op trace: " + path);
+    }
+    pos_ = sizeof(kMagic);
+    return Result::OK();
+}
+
+bool OpTraceReader::readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos_ < size_; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data_[pos_++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool OpTraceReader::next(TraceRecord& record) {
+    if (!data_ || pos_ >= size_) {
+        return false;
+    }
+    size_t start = pos_;
+    uint8_t op = static_cast<uint8_t>(data_[pos_++]);
+    // a chunk starts: its records count from its clock
+    if (op == kClockRecord) {
+        if (!readVarint(micros_) || pos_ >= size_) {
+            error_ = Result::Error("Damaged op trace " + path_ + " at byte " + std::to_string(start));
+            pos_ = size_;
+            return false;
+        }
+        op = static_cast<uint8_t>(data_[pos_++]);
+    }
+    uint64_t delta, keySize;
+    bool ok = op < static_cast<uint8_t>(TraceOp::NumOps) && readVarint(delta) && readVarint(keySize) &&
+              keySize <= size_ - pos_;
+    if (ok) {
+        record.op = static_cast<TraceOp>(op);
+        record.key = data_ + pos_;
+        record.keySize = keySize;
+        pos_ += keySize;
+        record.valueSize = 0;
+        record.endKey = nullptr;
+        record.endKeySize = 0;
+        if (record.op == TraceOp::Put) {
+            ok = readVarint(record.valueSize);
+        } else if (record.op == TraceOp::Scan) {
+            uint64_t endKeySize;
+            ok = readVarint(endKeySize) && endKeySize <= size_ - pos_;
+            if (ok) {
+                record.endKey = data_ + pos_;
+                record.endKeySize = endKeySize;
+                pos_ += endKeySize;
+            }
+        }
+    }
+    if (!ok) {
+        error_ = Result::Error("Damaged op trace " + path_ + " at byte " + std::to_string(start));
+        pos_ = size_;
+        return false;
+    }
+    micros_ += delta;
+    record.micros = micros_;
+    return true;
+}
@@ -0,0 +1,122 @@
+#ifndef OP_TRACE_H
+#define OP_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "result.h"
+
+// The ops an op trace holds. Read-modify-writes are traced as their get and
+// their put.
+enum class TraceOp : uint8_t {
+    Get,
+    Put,
+    Remove,
+    Scan,
+    NumOps
+};
+
+// One op of a trace, as the reader hands it out. key and endKey point into
+// the mapped file.
+struct TraceRecord {
+    TraceOp op;
+    uint64_t micros;      // since the start of the trace
+    const char* key;
+    size_t keySize;
+    uint64_t valueSize;   // puts only
+    const char* endKey;   // scans only
+    size_t endKeySize;
+};
+
+//
+// Op traces: a compact binary log of the ops issued to a store, captured with
+// --record_trace and replayed by the replay workload.
+//
+// A trace is an 8-byte magic followed by one record per op: the op type as a
+// byte, then as varints the micros since the previous record, the key size,
+// the key, and the value size of a put or the end key of a scan. Values are
+// not kept; replay generates values of the recorded size.
+//
+// Threads record into buffers of their own and hand them to the file in
+// chunks, each opened by a clock record: the byte 0xff and, as a varint, the
+// micros since the start of the trace. Records are in time order within a
+// chunk; chunks of different threads overlap in time.
+//
+class OpTraceWriter {
+public:
+    OpTraceWriter() = default;
+    ~OpTraceWriter();
+
+    Result open(const std::string& path);
+    Result close();
+
+    // When the trace started, on the clock of nowMicros.
+    uint64_t startMicros() const { return startMicros_; }
+    // Appends a chunk of encoded records. Safe to call from all threads at once.
+    void append(const std::string& chunk);
+
+    static uint64_t nowMicros();
+
+    OpTraceWriter(const OpTraceWriter&) = delete;
+    OpTraceWriter& operator=(const OpTraceWriter&) = delete;
+
+private:
+    std::mutex mutex_;
+    FILE* file_ = nullptr;
+    std::string path_;
+    uint64_t startMicros_ = 0;
+};
+
+// OpTraceBuffer records the ops of one thread, handing them to the writer a
+// chunk at a time, so that the writer's lock is taken once per chunk rather
+// than once per op. The last chunk goes when the buffer is destroyed.
+class OpTraceBuffer {
+public:
+    explicit OpTraceBuffer(OpTraceWriter* writer) : writer_(writer) {}
+    ~OpTraceBuffer();
+
+    // Records an op issued now.
+    void append(TraceOp op, const std::string& key, uint64_t valueSize, const std::string* endKey = nullptr);
+    void flush();
+
+    OpTraceBuffer(const OpTraceBuffer&) = delete;
+    OpTraceBuffer& operator=(const OpTraceBuffer&) = delete;
+
+private:
+    OpTraceWriter* writer_;
+    std::string chunk_;
+    uint64_t lastMicros_ = 0;   // of the last record in chunk_
+};
+
+// Reads a trace through a read-only mapping, so traces larger than memory
+// stream from the page cache. Each replay thread walks the whole trace with a
+// reader of its own.
+class OpTraceReader {
+public:
+    OpTraceReader() = default;
+    ~OpTraceReader();
+
+    Result open(const std::string& path);
+
+    // Decodes the next record into record. Returns false at the end of the
+    // trace, or on a damaged record, which error() then reports.
+    bool next(TraceRecord& record);
+    const Result& error() const { return error_; }
+
+    OpTraceReader(const OpTraceReader&) = delete;
+    OpTraceReader& operator=(const OpTraceReader&) = delete;
+
+private:
+    bool readVarint(uint64_t& value);
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    uint64_t micros_ = 0;
+    std::string path_;
+    Result error_ = Result::OK();
+};
+
+#endif // OP_TRACE_H
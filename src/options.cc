@@ -27,6 +27,8 @@ Result Options::parse(int argc, char *argv[]) {
 
         if (key == "adapter") {
             adapter = value;
+        } else if (key == "plugin_path") {
+            pluginPath = value;
         } else {
             options_[key] = value;
         }
@@ -9,6 +9,7 @@
 class Options {
 public:
 	std::string adapter;
+	std::string pluginPath = "./adapters";  // ':'-separated plugin directories
 
 	Options();
 	~Options();
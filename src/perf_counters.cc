@@ -0,0 +1,109 @@
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint64_t kEventConfigs[PERF_NUM_EVENTS] = {
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_CACHE_MISSES,   // last-level cache misses on most CPUs
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int openEvent(uint64_t config, bool excludeKernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid 0, cpu -1: this thread, on whichever CPU it runs.
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        fds_[i] = -1;
+        values_[i] = 0;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::open() {
+    bool any = false;
+    int err = 0;
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        // Counting kernel time needs perf_event_paranoid <= 1; fall back to
+        // user space only rather than losing the counter.
+        fds_[i] = openEvent(kEventConfigs[i], false);
+        if (fds_[i] < 0 && (errno == EACCES || errno == EPERM)) {
+            fds_[i] = openEvent(kEventConfigs[i], true);
+        }
+        if (fds_[i] < 0) {
+            err = errno;
+        } else {
+            any = true;
+        }
+    }
+
+    if (err != 0) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            fprintf(stderr, "Warning: some perf counters are unavailable: %s\n", strerror(err));
+        }
+    }
+    return any;
+}
+
+void PerfCounters::start() {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        values_[i] = 0;
+        if (fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (fds_[i] < 0) {
+            continue;
+        }
+        ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (read(fds_[i], data, sizeof(data)) != sizeof(data)) {
+            continue;
+        }
+        if (data[2] > 0 && data[2] < data[1]) {
+            values_[i] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        } else {
+            values_[i] = data[0];
+        }
+    }
+}
+
+bool PerfCounters::valid(PerfEvent event) const {
+    return fds_[event] >= 0;
+}
+
+uint64_t PerfCounters::value(PerfEvent event) const {
+    return values_[event];
+}
@@ -0,0 +1,39 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+
+enum PerfEvent {
+    PERF_INSTRUCTIONS,
+    PERF_CYCLES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_EVENTS
+};
+
+//
+// PerfCounters: hardware counters for the calling thread, opened through
+// perf_event_open. Counters the kernel or the machine does not allow are
+// simply left invalid, so callers never have to treat them as an error.
+//
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    // Opens the counters for the calling thread. Returns false if none of
+    // them could be opened.
+    bool open();
+    void start();
+    void stop();
+
+    bool valid(PerfEvent event) const;
+    // Counter value, scaled up if the kernel had to multiplex it.
+    uint64_t value(PerfEvent event) const;
+
+private:
+    int fds_[PERF_NUM_EVENTS];
+    uint64_t values_[PERF_NUM_EVENTS];
+};
+
+#endif // PERF_COUNTERS_H
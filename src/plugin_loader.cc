@@ -1,37 +1,72 @@
 #include <dlfcn.h>
-#include <dirent.h>
-#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
 #include "kvstore_factory.h"
+#include "plugin_loader.h"
 
 using RegisterFunc = void (*)(KVStoreFactory&);
 
-void loadPlugins(KVStoreFactory& factory, const std::string& pluginDir) {
-    DIR* dir = opendir(pluginDir.c_str());
-    if (!dir) {
-        std::cerr << "Cannot open plugin directory: " << pluginDir << std::endl;
-        return;
+// Optional per-directory manifest mapping adapter names to libraries, one
+// "<adapter> <library>" pair per line. '#' starts a comment.
+static const char* const kManifestName = "adapters.manifest";
+
+static bool fileExists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Returns the library for name in dir: the manifest entry if there is one,
+// otherwise the lib<name>_adapter.so naming convention used by adapters/.
+static std::string findLibrary(const std::string& dir, const std::string& name) {
+    std::ifstream manifest(dir + "/" + kManifestName);
+    std::string line;
+    while (std::getline(manifest, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string adapter, library;
+        if (fields >> adapter >> library && adapter == name) {
+            std::string path = library[0] == '/' ? library : dir + "/" + library;
+            return fileExists(path) ? path : "";
+        }
     }
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        std::string name = entry->d_name;
-        // Simple check: load shared libraries ending with .so
-        if (name.size() > 3 && name.substr(name.size() - 3) == ".so") {
-            std::string fullPath = pluginDir + "/" + name;
-            void* handle = dlopen(fullPath.c_str(), RTLD_NOW | RTLD_GLOBAL);
-            if (!handle) {
-                std::cerr << "Error loading " << fullPath << ": " << dlerror() << std::endl;
-                continue;
-            }
-
-            // Look for a symbol "registerAdapters"
-            RegisterFunc regFunc = reinterpret_cast<RegisterFunc>(dlsym(handle, "registerAdapters"));
-            if (regFunc) {
-                regFunc(factory);
-            } else {
-                std::cerr << "No registerAdapters function in " << fullPath << std::endl;
-            }
+    std::string path = dir + "/lib" + name + "_adapter.so";
+    return fileExists(path) ? path : "";
+}
+
+Result loadPlugin(KVStoreFactory& factory, const std::string& name,
+                  const std::string& pluginPath, std::string* path) {
+    std::string fullPath;
+    std::istringstream dirs(pluginPath);
+    std::string dir;
+    while (fullPath.empty() && std::getline(dirs, dir, ':')) {
+        if (!dir.empty()) {
+            fullPath = findLibrary(dir, name);
         }
     }
-    closedir(dir);
-}
\ No newline at end of file
+    if (fullPath.empty()) {
+        return Result::NotFound("No plugin for adapter " + name + " in " + pluginPath);
+    }
+
+    // Only this plugin is opened, and its symbols stay private to it.
+    void* handle = dlopen(fullPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        return Result::Error("Error loading " + fullPath + ": " + dlerror());
+    }
+
+    // Look for a symbol "registerAdapters"
+    RegisterFunc regFunc = reinterpret_cast<RegisterFunc>(dlsym(handle, "registerAdapters"));
+    if (!regFunc) {
+        return Result::Error("No registerAdapters function in " + fullPath);
+    }
+    regFunc(factory);
+    if (!factory.hasAdapter(name)) {
+        return Result::Error(fullPath + " does not register adapter " + name);
+    }
+
+    if (path) {
+        *path = fullPath;
+    }
+    return Result::OK();
+}
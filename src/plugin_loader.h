@@ -0,0 +1,16 @@
+#ifndef PLUGIN_LOADER_H
+#define PLUGIN_LOADER_H
+
+#include <string>
+
+#include "result.h"
+
+class KVStoreFactory;
+
+// Finds the shared library that provides adapter `name` in pluginPath, a
+// ':'-separated list of directories, and lets it register with the factory.
+// On success, path holds the library that was loaded.
+Result loadPlugin(KVStoreFactory& factory, const std::string& name,
+                  const std::string& pluginPath, std::string* path);
+
+#endif // PLUGIN_LOADER_H
@@ -0,0 +1,164 @@
+#include "resources.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// Reads "name: value" lines from a /proc file. Returns false if the file
+// cannot be opened.
+static bool readProcFields(const char* path, const char* const* names, uint64_t** values, size_t count) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        for (size_t i = 0; i < count; i++) {
+            size_t len = strlen(names[i]);
+            if (strncmp(line, names[i], len) == 0 && line[len] == ':') {
+                unsigned long long v = 0;
+                sscanf(line + len + 1, "%llu", &v);
+                *values[i] = v;
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+ResourceSample ResourceSample::now() {
+    ResourceSample s;
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        s.userMicros = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec;
+        s.sysMicros = usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+        s.voluntarySwitches = usage.ru_nvcsw;
+        s.involuntarySwitches = usage.ru_nivcsw;
+    }
+
+    // VmRSS is reported in kB.
+    static const char* const statusNames[] = {"VmRSS"};
+    uint64_t rssKb = 0;
+    uint64_t* statusValues[] = {&rssKb};
+    readProcFields("/proc/self/status", statusNames, statusValues, 1);
+    s.rssBytes = rssKb * 1024;
+
+    static const char* const ioNames[] = {"read_bytes", "write_bytes"};
+    uint64_t* ioValues[] = {&s.readBytes, &s.writeBytes};
+    s.ioAvailable = readProcFields("/proc/self/io", ioNames, ioValues, 2);
+
+    return s;
+}
+
+ResourceSample ResourceSample::ofThread() {
+    ResourceSample s;
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        s.userMicros = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec;
+        s.sysMicros = usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+        s.voluntarySwitches = usage.ru_nvcsw;
+        s.involuntarySwitches = usage.ru_nivcsw;
+    }
+    return s;
+}
+
+ResourceMonitor::ResourceMonitor(uint64_t intervalMs)
+    : intervalMs_(intervalMs), running_(false) {}
+
+ResourceMonitor::~ResourceMonitor() {
+    if (running_) {
+        stop();
+    }
+}
+
+void ResourceMonitor::start() {
+    rssSamples_.clear();
+    begin_ = ResourceSample::now();
+    running_ = true;
+    if (intervalMs_ > 0) {
+        sampler_ = std::thread(&ResourceMonitor::sampleLoop, this);
+    }
+}
+
+void ResourceMonitor::sampleLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        cv_.wait_for(lock, std::chrono::milliseconds(intervalMs_));
+        if (!running_) {
+            break;
+        }
+        rssSamples_.push_back(ResourceSample::now().rssBytes);
+    }
+}
+
+ResourceUsage ResourceMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (sampler_.joinable()) {
+        sampler_.join();
+    }
+
+    ResourceSample end = ResourceSample::now();
+    rssSamples_.push_back(end.rssBytes);
+
+    ResourceUsage usage;
+    usage.valid = true;
+    usage.userSeconds = (end.userMicros - begin_.userMicros) * 1e-6;
+    usage.sysSeconds = (end.sysMicros - begin_.sysMicros) * 1e-6;
+    usage.voluntarySwitches = end.voluntarySwitches - begin_.voluntarySwitches;
+    usage.involuntarySwitches = end.involuntarySwitches - begin_.involuntarySwitches;
+    usage.ioAvailable = begin_.ioAvailable && end.ioAvailable;
+    if (usage.ioAvailable) {
+        usage.readBytes = end.readBytes - begin_.readBytes;
+        usage.writeBytes = end.writeBytes - begin_.writeBytes;
+    }
+
+    uint64_t sum = 0;
+    for (uint64_t rss : rssSamples_) {
+        sum += rss;
+    }
+    usage.peakRssBytes = std::max(begin_.rssBytes,
+                                  *std::max_element(rssSamples_.begin(), rssSamples_.end()));
+    usage.steadyRssBytes = sum / rssSamples_.size();
+    return usage;
+}
+
+// One walk over the files under path; false if it broke off.
+static bool walkDirectoryBytes(const std::string& path, uint64_t* bytes) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(path, ec), end;
+    if (ec) {
+        return false;
+    }
+    *bytes = 0;
+    for (; it != end; it.increment(ec)) {
+        if (ec) {
+            return false;
+        }
+        // a file removed since it was listed is skipped
+        struct stat st;
+        if (lstat(it->path().c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            *bytes += static_cast<uint64_t>(st.st_blocks) * 512;
+        }
+    }
+    return !ec;
+}
+
+bool directoryBytes(const std::string& path, uint64_t* bytes) {
+    // files come and go under a live store: a file that vanishes is skipped,
+    // but a walk cannot go on past a directory that vanished, so it is retried
+    for (int attempt = 0; attempt < 3; attempt++) {
+        if (walkDirectoryBytes(path, bytes)) {
+            return true;
+        }
+    }
+    return false;
+}
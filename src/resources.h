@@ -0,0 +1,94 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// ResourceSample: a point-in-time snapshot of process-wide resource counters.
+//
+struct ResourceSample {
+    uint64_t userMicros = 0;           // getrusage
+    uint64_t sysMicros = 0;
+    uint64_t voluntarySwitches = 0;
+    uint64_t involuntarySwitches = 0;
+    uint64_t rssBytes = 0;             // /proc/self/status VmRSS
+    uint64_t readBytes = 0;            // /proc/self/io, bytes that hit storage
+    uint64_t writeBytes = 0;
+    bool ioAvailable = false;          // /proc/self/io is not always readable
+
+    static ResourceSample now();
+    // The CPU time and context switches of the calling thread alone; the
+    // other fields stay zero.
+    static ResourceSample ofThread();
+};
+
+//
+// ResourceUsage: what a workload consumed between two samples.
+//
+struct ResourceUsage {
+    bool valid = false;
+    double userSeconds = 0;
+    double sysSeconds = 0;
+    uint64_t peakRssBytes = 0;
+    uint64_t steadyRssBytes = 0;       // mean of the samples taken during the run
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+    bool ioAvailable = false;
+    uint64_t voluntarySwitches = 0;
+    uint64_t involuntarySwitches = 0;
+    // CPU and context switches are of one group's threads, when groups ran
+    // side by side; RSS and I/O stay those of the whole process.
+    bool perGroup = false;
+};
+
+//
+// Footprint: what a loaded dataset costs in memory and on disk (--footprint),
+// from samples taken before the load and after the store came to rest.
+//
+struct Footprint {
+    bool valid = false;
+    uint64_t keys = 0;                 // keys in the keyspace loaded
+    double logicalBytes = 0;           // keys and values as handed to the store
+    uint64_t rssBeforeBytes = 0;
+    uint64_t rssAfterBytes = 0;
+    bool diskAvailable = false;        // false if the store reports no data directory
+    uint64_t diskBeforeBytes = 0;
+    uint64_t diskAfterBytes = 0;
+    double quiesceSeconds = 0;         // spent bringing the store to rest
+};
+
+// Space the files under path take on disk, from their allocated blocks.
+// Returns false if path cannot be read, or keeps changing under the walk.
+bool directoryBytes(const std::string& path, uint64_t* bytes);
+
+//
+// ResourceMonitor: samples the process at workload boundaries and, from a
+// background thread, every intervalMs in between to track RSS over time.
+//
+class ResourceMonitor {
+public:
+    explicit ResourceMonitor(uint64_t intervalMs);
+    ~ResourceMonitor();
+
+    void start();
+    ResourceUsage stop();
+
+private:
+    void sampleLoop();
+
+    uint64_t intervalMs_;
+    ResourceSample begin_;
+    std::vector<uint64_t> rssSamples_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_;
+    std::thread sampler_;
+};
+
+#endif // RESOURCES_H
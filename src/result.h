@@ -1,10 +1,16 @@
 #ifndef KV_STATUS_H
 #define KV_STATUS_H
 
+#include <memory>
 #include <string>
 
+// Result is returned by every store operation, so the success path must not
+// touch the heap: the code is a plain enum and the message is only allocated
+// for errors that actually carry one.
 class Result {
 public:
+    enum Code { kOk, kNotFound, kError };
+
     // Returns a success status.
     static Result OK() {
         return Result();
@@ -12,33 +18,58 @@ public:
 
     // Returns a status representing a "not found" error.
     static Result NotFound(const std::string& msg = "") {
-        return Result("NotFound", msg);
+        return Result(kNotFound, msg);
     }
 
     // Returns a status representing a generic error.
     static Result Error(const std::string& msg = "") {
-        return Result("Error", msg);
+        return Result(kError, msg);
+    }
+
+    Result(const Result& other)
+        : code_(other.code_),
+          message_(other.message_ ? std::make_unique<std::string>(*other.message_) : nullptr) {}
+    Result(Result&& other) noexcept = default;
+    Result& operator=(const Result& other) {
+        if (this != &other) {
+            code_ = other.code_;
+            message_ = other.message_ ? std::make_unique<std::string>(*other.message_) : nullptr;
+        }
+        return *this;
     }
+    Result& operator=(Result&& other) noexcept = default;
 
     // Returns true if the status represents success.
     bool ok() const {
-        return code_.empty();
+        return code_ == kOk;
+    }
+
+    bool isNotFound() const {
+        return code_ == kNotFound;
     }
 
     // Getters for code and message.
-    std::string code() const { return code_; }
-    std::string message() const { return message_; }
+    Code code() const { return code_; }
+    std::string codeName() const {
+        switch (code_) {
+            case kOk: return "";
+            case kNotFound: return "NotFound";
+            default: return "Error";
+        }
+    }
+    std::string message() const { return message_ ? *message_ : std::string(); }
 
 private:
-    std::string code_;
-    std::string message_;
+    Code code_ = kOk;
+    std::unique_ptr<std::string> message_;
 
     // Private constructor for a successful status.
     Result() = default;
 
     // Private constructor for an error status.
-    Result(const std::string& code, const std::string& message)
-        : code_(code), message_(message) {}
+    Result(Code code, const std::string& message)
+        : code_(code),
+          message_(message.empty() ? nullptr : std::make_unique<std::string>(message)) {}
 };
 
 #endif // KV_STATUS_H
@@ -13,6 +13,20 @@ uint64_t SimpleClock::nowMicros() const {
     return static_cast<uint64_t>(micros.count());
 }
 
+uint64_t SimpleClock::nowNanos() const {
+    auto now = std::chrono::steady_clock::now();
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now.time_since_epoch());
+    return static_cast<uint64_t>(nanos.count());
+}
+
+const char* operationTypeName(OperationType type) {
+    static const char* const names[kNumOperationTypes] = {
+        "get", "put", "remove", "scan", "rmw"
+    };
+    return names[static_cast<int>(type)];
+}
+
 // ----------
 // Stats Implementation
 // ----------
@@ -22,7 +36,10 @@ Stats::Stats()
       finishTime_(0),
       done_(0),
       bytes_(0),
-      seconds_(0) {
+      writeBytes_(0),
+      seconds_(0),
+      hasSession_(false),
+      sessionSetupMicros_(0) {
     start();
 }
 
@@ -30,39 +47,116 @@ Stats::~Stats() {
     delete clock_;
 }
 
+void Stats::enablePerfCounters() {
+    perf_ = std::make_unique<PerfCounters>();
+    if (!perf_->open()) {
+        perf_.reset();
+    }
+}
+
+Result Stats::openLatencyLog(const std::string& path, uint64_t capacity, int thread, const std::string& workload) {
+    latencyLog_ = std::make_unique<LatencyLog>();
+    auto r = latencyLog_->open(path, capacity, thread, workload);
+    if (!r.ok()) {
+        latencyLog_.reset();
+    }
+    return r;
+}
+
 void Stats::start() {
+    if (AllocCounter::enabled()) {
+        AllocCounter::reset();
+    }
+    if (perf_) {
+        perf_->start();
+    }
     startTime_ = clock_->nowMicros();
 	lastOpTime_ = startTime_;
+	lastOpNanos_ = startTime_ * 1000;
+	if (latencyLog_) {
+		latencyLog_->reset();
+	}
 	finishTime_ = 0;
 	done_ = 0;
 	bytes_ = 0;
+	writeBytes_ = 0;
 	seconds_ = 0;
 	opLatencies_.clear();
+	opTypes_.clear();
+	rmwReadTime_ = 0;
+	rmwReadLatencies_.clear();
+	rmwWriteLatencies_.clear();
+	std::fill(std::begin(opCounts_), std::end(opCounts_), 0);
+	std::fill(std::begin(found_), std::end(found_), 0);
+	valueSizes_.clear();
+	std::fill(std::begin(verified_), std::end(verified_), 0);
 }
 
 
-void Stats::finishedReadOp(uint64_t opBytes, bool found) {
-    uint64_t now = clock_->nowMicros();
+void Stats::markOpStart(uint64_t micros) {
+    lastOpTime_ = micros;
+    lastOpNanos_ = micros * 1000;
+}
+
+void Stats::recordOp(OperationType type, bool found) {
+    uint64_t now;
+    if (latencyLog_) {
+        // one clock read serves both the log and the stats
+        uint64_t nowNanos = clock_->nowNanos();
+        latencyLog_->append(lastOpNanos_, nowNanos - lastOpNanos_, static_cast<int>(type));
+        lastOpNanos_ = nowNanos;
+        now = nowNanos / 1000;
+    } else {
+        now = clock_->nowMicros();
+    }
     opLatencies_.push_back(now - lastOpTime_);
+    opTypes_.push_back(static_cast<uint8_t>(type));
     lastOpTime_ = now;
-    reads_++;
+    opCounts_[static_cast<int>(type)]++;
     if (found) {
-        found_++;
+        found_[static_cast<int>(type)]++;
     }
 }
 
+void Stats::finishedReadOp(uint64_t opBytes, bool found) {
+    recordOp(OperationType::READ, found);
+    finishedOps(1, opBytes);
+}
+
 void Stats::finishedWriteOp(uint64_t opBytes) {
-    uint64_t now = clock_->nowMicros();
-    opLatencies_.push_back(now - lastOpTime_);
-    lastOpTime_ = now;
-    writes_++;
+    recordOp(OperationType::WRITE, true);
+    writeBytes_ += opBytes;
+    finishedOps(1, opBytes);
 }
 
 void Stats::finishedDeleteOp(uint64_t opBytes) {
-    uint64_t now = clock_->nowMicros();
-    opLatencies_.push_back(now - lastOpTime_);
-    lastOpTime_ = now;
-    deletes_++;
+    recordOp(OperationType::DELETE, true);
+    finishedOps(1, opBytes);
+}
+
+void Stats::finishedScanOp(uint64_t opBytes, bool found) {
+    recordOp(OperationType::SCAN, found);
+    finishedOps(1, opBytes);
+}
+
+void Stats::finishedRmwRead() {
+    rmwReadTime_ = clock_->nowMicros();
+    rmwReadLatencies_.push_back(rmwReadTime_ - lastOpTime_);
+}
+
+void Stats::finishedRmwOp(uint64_t opBytes, bool found) {
+    recordOp(OperationType::RMW, found);
+    rmwWriteLatencies_.push_back(lastOpTime_ - rmwReadTime_);
+    writeBytes_ += opBytes;
+    finishedOps(1, opBytes);
+}
+
+void Stats::recordValueSize(uint64_t valueBytes) {
+    valueSizes_.push_back(static_cast<double>(valueBytes));
+}
+
+void Stats::finishedVerify(VerifyOutcome outcome) {
+    verified_[static_cast<int>(outcome)]++;
 }
 
 void Stats::finishedOps(int64_t numOps, uint64_t opBytes) {
@@ -70,17 +164,41 @@ void Stats::finishedOps(int64_t numOps, uint64_t opBytes) {
     bytes_ += opBytes;
 }
 
+void Stats::finishedSessionSetup(uint64_t micros) {
+    hasSession_ = true;
+    sessionSetupMicros_ = micros;
+}
+
 void Stats::stop() {
     finishTime_ = clock_->nowMicros();
     seconds_ = (finishTime_ - startTime_) * 1e-6;  // convert micros to seconds
+    if (perf_) {
+        perf_->stop();
+    }
+    if (AllocCounter::enabled()) {
+        allocs_[0] = AllocCounter::counts(AllocScope::Harness);
+        allocs_[1] = AllocCounter::counts(AllocScope::Adapter);
+    }
 }
 
 uint64_t Stats::getStart() const { return startTime_; }
 uint64_t Stats::getFinish() const { return finishTime_; }
 uint64_t Stats::getOps() const { return done_; }
 uint64_t Stats::getBytes() const { return bytes_; }
+uint64_t Stats::getWriteBytes() const { return writeBytes_; }
 double Stats::getSeconds() const { return seconds_; }
-std::vector<double> Stats::getOpLatencies() const { return opLatencies_; }
+const std::vector<double>& Stats::getOpLatencies() const { return opLatencies_; }
+const std::vector<uint8_t>& Stats::getOpTypes() const { return opTypes_; }
+uint64_t Stats::getOpCount(OperationType type) const { return opCounts_[static_cast<int>(type)]; }
+uint64_t Stats::getFound(OperationType type) const { return found_[static_cast<int>(type)]; }
+const std::vector<double>& Stats::getRmwReadLatencies() const { return rmwReadLatencies_; }
+const std::vector<double>& Stats::getRmwWriteLatencies() const { return rmwWriteLatencies_; }
+std::vector<double> Stats::getValueSizes() const { return valueSizes_; }
+bool Stats::hasSession() const { return hasSession_; }
+uint64_t Stats::getSessionSetupMicros() const { return sessionSetupMicros_; }
+const PerfCounters* Stats::getPerfCounters() const { return perf_.get(); }
+AllocCounts Stats::getAllocs(AllocScope scope) const { return allocs_[static_cast<int>(scope)]; }
+uint64_t Stats::getVerified(VerifyOutcome outcome) const { return verified_[static_cast<int>(outcome)]; }
 
 void Stats::merge(const Stats& other) {
     if (other.startTime_ < startTime_) {
@@ -91,6 +209,11 @@ void Stats::merge(const Stats& other) {
     }
     done_ += other.done_;
     bytes_ += other.bytes_;
+    for (int i = 0; i < kNumOperationTypes; i++) {
+        opCounts_[i] += other.opCounts_[i];
+        found_[i] += other.found_[i];
+    }
+    writeBytes_ += other.writeBytes_;
     seconds_ = (finishTime_ - startTime_) * 1e-6;
 }
 
@@ -108,6 +231,8 @@ void CombinedStats::addStats(std::unique_ptr<Stats> stat) {
     // Calculate throughput (ops/sec).
     double opThroughput = static_cast<double>(ops) / elapsed;
     throughputOps_.push_back(opThroughput);
+    totalOps_ += ops;
+    totalWriteBytes_ += stat->getWriteBytes();
     // If bytes > 0, compute MB/sec.
     if (stat->getBytes() > 0) {
         double mbPerSec = (static_cast<double>(stat->getBytes()) / 1048576.0) / elapsed;
@@ -116,6 +241,88 @@ void CombinedStats::addStats(std::unique_ptr<Stats> stat) {
     // Append the per-operation latencies recorded in Stats.
     const auto& latencies = stat->getOpLatencies();
     opLatencies_.insert(opLatencies_.end(), latencies.begin(), latencies.end());
+    const auto& types = stat->getOpTypes();
+    for (size_t i = 0; i < types.size(); i++) {
+        typeLatencies_[types[i]].push_back(latencies[i]);
+    }
+    rmwReadLatencies_.insert(rmwReadLatencies_.end(), stat->getRmwReadLatencies().begin(),
+                             stat->getRmwReadLatencies().end());
+    rmwWriteLatencies_.insert(rmwWriteLatencies_.end(), stat->getRmwWriteLatencies().begin(),
+                              stat->getRmwWriteLatencies().end());
+    for (int i = 0; i < kNumOperationTypes; i++) {
+        opCounts_[i] += stat->getOpCount(static_cast<OperationType>(i));
+        found_[i] += stat->getFound(static_cast<OperationType>(i));
+    }
+    const auto& valueSizes = stat->getValueSizes();
+    valueSizes_.insert(valueSizes_.end(), valueSizes.begin(), valueSizes.end());
+    if (const PerfCounters* perf = stat->getPerfCounters()) {
+        for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+            if (perf->valid(static_cast<PerfEvent>(i))) {
+                perfTotals_[i] += perf->value(static_cast<PerfEvent>(i));
+                perfOps_[i] += ops;
+            }
+        }
+    }
+    if (AllocCounter::enabled()) {
+        countedAllocs_ = true;
+        for (int i = 0; i < 2; i++) {
+            AllocCounts c = stat->getAllocs(static_cast<AllocScope>(i));
+            allocs_[i].allocs += c.allocs;
+            allocs_[i].bytes += c.bytes;
+        }
+    }
+    for (int i = 0; i < static_cast<int>(VerifyOutcome::NumOutcomes); i++) {
+        verified_[i] += stat->getVerified(static_cast<VerifyOutcome>(i));
+    }
+    if (stat->hasSession()) {
+        sessionSetup_.push_back(static_cast<double>(stat->getSessionSetupMicros()));
+    }
+}
+
+void CombinedStats::setResources(const ResourceUsage& usage) {
+    resources_ = usage;
+}
+
+void CombinedStats::setHarnessNanosPerOp(double nanos) {
+    harnessNanosPerOp_ = nanos;
+}
+
+void CombinedStats::setFootprint(const Footprint& footprint) {
+    footprint_ = footprint;
+}
+
+void CombinedStats::setStoreReport(const std::string& report) {
+    storeReport_ = report;
+}
+
+double CombinedStats::avgValueSize() const {
+    return valueSizes_.empty() ? 0.0 : calcAvg(valueSizes_);
+}
+
+double CombinedStats::avgThroughput() const {
+    return throughputOps_.empty() ? 0.0 : calcAvg(throughputOps_);
+}
+
+double CombinedStats::totalThroughput() const {
+    double total = 0;
+    for (double ops : throughputOps_) {
+        total += ops;
+    }
+    return total;
+}
+
+double CombinedStats::latencyPercentile(double percentile) const {
+    return calcPercentile(opLatencies_, percentile);
+}
+
+uint64_t CombinedStats::verifyFailures() const {
+    return verified_[static_cast<int>(VerifyOutcome::KeyMismatch)] +
+           verified_[static_cast<int>(VerifyOutcome::Corrupt)] +
+           verified_[static_cast<int>(VerifyOutcome::Stale)];
+}
+
+std::string CombinedStats::getBenchName() const {
+    return benchName_;
 }
 
 void CombinedStats::reportFinal() const {
@@ -131,6 +338,7 @@ void CombinedStats::reportFinal() const {
         printf("   Median : %.3f\n", medLatency);
         printf("   P90    : %.3f\n", p90Latency);
         printf("   P99    : %.3f\n", p99Latency);
+        reportOpTypes();
     }
     // Report throughput results if available.
     if (!throughputOps_.empty()) {
@@ -142,10 +350,151 @@ void CombinedStats::reportFinal() const {
             printf(" (%.1f MB/sec)", avgMB);
         }
         printf("\n");
+        // Share of each op's time spent in the harness rather than the store.
+        if (harnessNanosPerOp_ > 0 && avgOps > 0) {
+            printf("   Harness: %.1f ns/op (%.1f%% of op time)\n",
+                   harnessNanosPerOp_, 100.0 * harnessNanosPerOp_ * avgOps / 1e9);
+        }
+    }
+    // Sizes of the values actually written, which vary with --distribution.
+    if (!valueSizes_.empty()) {
+        printf("Value size (bytes):\n");
+        printf("   Avg    : %.1f\n", calcAvg(valueSizes_));
+        printf("   Median : %.0f\n", calcMedian(valueSizes_));
+        printf("   P90    : %.0f\n", calcPercentile(valueSizes_, 90.0));
+        printf("   P99    : %.0f\n", calcPercentile(valueSizes_, 99.0));
+        printf("   Max    : %.0f\n", *std::max_element(valueSizes_.begin(), valueSizes_.end()));
+    }
+    // Process-wide resources, including any background work of the adapter;
+    // with groups side by side, CPU and switches are of the group's threads.
+    if (resources_.valid) {
+        double cpuSeconds = resources_.userSeconds + resources_.sysSeconds;
+        const char* scope = resources_.perGroup ? " (whole step)" : "";
+        printf("Resources:\n");
+        printf("   CPU    : %.3f s user, %.3f s sys", resources_.userSeconds, resources_.sysSeconds);
+        if (cpuSeconds > 0) {
+            printf(" (%.0f ops/core-sec)", totalOps_ / cpuSeconds);
+        }
+        printf("%s\n", resources_.perGroup ? ", this group's threads" : "");
+        printf("   RSS    : %.1f MB peak, %.1f MB steady%s\n",
+               resources_.peakRssBytes / 1048576.0, resources_.steadyRssBytes / 1048576.0, scope);
+        if (resources_.ioAvailable) {
+            printf("   I/O    : %.1f MB read, %.1f MB written",
+                   resources_.readBytes / 1048576.0, resources_.writeBytes / 1048576.0);
+            if (totalWriteBytes_ > 0 && !resources_.perGroup) {
+                printf(" (write amp %.2f)", static_cast<double>(resources_.writeBytes) / totalWriteBytes_);
+            }
+            printf("%s\n", scope);
+        }
+        printf("   Ctx sw : %llu voluntary, %llu involuntary\n",
+               static_cast<unsigned long long>(resources_.voluntarySwitches),
+               static_cast<unsigned long long>(resources_.involuntarySwitches));
+    }
+    // Cost of the loaded dataset, once the store came to rest.
+    if (footprint_.valid && footprint_.keys > 0) {
+        double keys = static_cast<double>(footprint_.keys);
+        double rssGrowth = static_cast<double>(footprint_.rssAfterBytes) - footprint_.rssBeforeBytes;
+        printf("Footprint:\n");
+        printf("   Keys   : %llu (%.1f MB logical)\n", static_cast<unsigned long long>(footprint_.keys),
+               footprint_.logicalBytes / 1048576.0);
+        printf("   Memory : %.1f MB RSS growth, %.1f bytes/key\n", rssGrowth / 1048576.0, rssGrowth / keys);
+        if (footprint_.diskAvailable) {
+            double diskGrowth = static_cast<double>(footprint_.diskAfterBytes) - footprint_.diskBeforeBytes;
+            printf("   Disk   : %.1f MB growth, %.1f bytes/key", diskGrowth / 1048576.0, diskGrowth / keys);
+            if (footprint_.logicalBytes > 0) {
+                printf(" (space amp %.2f)", diskGrowth / footprint_.logicalBytes);
+            }
+            printf(", %.1f MB total\n", footprint_.diskAfterBytes / 1048576.0);
+        }
+        printf("   Quiesce: %.3f s\n", footprint_.quiesceSeconds);
+    }
+    // Hardware counters, normalized per op.
+    if (perfOps_[PERF_INSTRUCTIONS] > 0 || perfOps_[PERF_CYCLES] > 0 ||
+        perfOps_[PERF_LLC_MISSES] > 0 || perfOps_[PERF_BRANCH_MISSES] > 0) {
+        static const char* const names[PERF_NUM_EVENTS] = {
+            "Instr", "Cycles", "LLC", "Branch"
+        };
+        printf("Perf counters (per op; LLC and branch misses):\n");
+        for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+            if (perfOps_[i] == 0) {
+                continue;
+            }
+            printf("   %-6s : %.1f", names[i], static_cast<double>(perfTotals_[i]) / perfOps_[i]);
+            if (i == PERF_INSTRUCTIONS && perfOps_[PERF_CYCLES] == perfOps_[i] && perfTotals_[PERF_CYCLES] > 0) {
+                printf(" (IPC %.2f)", static_cast<double>(perfTotals_[i]) / perfTotals_[PERF_CYCLES]);
+            }
+            printf("\n");
+        }
+    }
+    // Heap allocations made by worker threads, split by who made them.
+    if (countedAllocs_ && totalOps_ > 0) {
+        static const char* const scopes[2] = {"Harness", "Adapter"};
+        printf("Allocations (per op):\n");
+        for (int i = 0; i < 2; i++) {
+            printf("   %-7s: %.2f allocs, %.1f bytes\n", scopes[i],
+                   static_cast<double>(allocs_[i].allocs) / totalOps_,
+                   static_cast<double>(allocs_[i].bytes) / totalOps_);
+        }
+    }
+    // Reads checked by --verify.
+    uint64_t verifiedReads = verifyFailures() + verified_[static_cast<int>(VerifyOutcome::Ok)];
+    if (verifiedReads > 0) {
+        printf("Verification:\n");
+        printf("   Reads  : %llu verified%s\n", static_cast<unsigned long long>(verifiedReads),
+               verifyFailures() > 0 ? ", FAILED" : "");
+        printf("   Errors : %llu key mismatch, %llu corrupt, %llu stale\n",
+               static_cast<unsigned long long>(verified_[static_cast<int>(VerifyOutcome::KeyMismatch)]),
+               static_cast<unsigned long long>(verified_[static_cast<int>(VerifyOutcome::Corrupt)]),
+               static_cast<unsigned long long>(verified_[static_cast<int>(VerifyOutcome::Stale)]));
+    }
+    // Session setup happens before the measured ops and is reported apart.
+    if (!sessionSetup_.empty()) {
+        printf("Session setup (µs):\n");
+        printf("   Avg    : %.3f\n", calcAvg(sessionSetup_));
+        printf("   Max    : %.3f\n", *std::max_element(sessionSetup_.begin(), sessionSetup_.end()));
+    }
+    // What the store itself saw, such as the hits of a cache adapter.
+    if (!storeReport_.empty()) {
+        printf("%s", storeReport_.c_str());
     }
     printf("========================\n");
 }
 
+// Latency and hit ratio of every op type the workload issued.
+void CombinedStats::reportOpTypes() const {
+    printf("Latency by op type (µs):\n");
+    for (int i = 0; i < kNumOperationTypes; i++) {
+        const std::vector<double>& latencies = typeLatencies_[i];
+        if (opCounts_[i] == 0 || latencies.empty()) {
+            continue;
+        }
+        OperationType type = static_cast<OperationType>(i);
+        printf("   %-6s : %llu ops, ", operationTypeName(type), static_cast<unsigned long long>(opCounts_[i]));
+        reportLatencyLine(nullptr, latencies);
+        if (type == OperationType::READ || type == OperationType::SCAN || type == OperationType::RMW) {
+            printf(", hit %.1f%%", 100.0 * found_[i] / opCounts_[i]);
+        }
+        printf("\n");
+        // a read-modify-write is also broken down into its two halves
+        if (type == OperationType::RMW && !rmwReadLatencies_.empty()) {
+            reportLatencyLine("read", rmwReadLatencies_);
+            printf("\n");
+            reportLatencyLine("write", rmwWriteLatencies_);
+            printf("\n");
+        }
+    }
+}
+
+// Prints the latency summary of one op type, on a line of its own if named.
+void CombinedStats::reportLatencyLine(const char* name, const std::vector<double>& latencies) const {
+    if (name) {
+        printf("     %-6s: ", name);
+    }
+    printf("avg %.3f, median %.3f, p90 %.3f, p99 %.3f",
+           calcAvg(latencies), calcMedian(latencies),
+           calcPercentile(latencies, 90.0), calcPercentile(latencies, 99.0));
+}
+
 double CombinedStats::calcAvg(const std::vector<double>& data) const {
     double sum = 0.0;
     for (double d : data) {
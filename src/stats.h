@@ -9,6 +9,12 @@
 #include <functional>
 #include <algorithm>
 
+#include "alloc_counter.h"
+#include "latency_log.h"
+#include "verify.h"
+#include "perf_counters.h"
+#include "resources.h"
+
 // --------------------------
 // SimpleClock: a minimal clock class
 // --------------------------
@@ -16,14 +22,24 @@ class SimpleClock {
 public:
     // Returns current time in microseconds.
     uint64_t nowMicros() const;
+    // The same clock, in nanoseconds.
+    uint64_t nowNanos() const;
 };
 
 enum class OperationType {
     READ,
     WRITE,
-    DELETE
+    DELETE,
+    SCAN,
+    RMW,     // read-modify-write
+    NUM_TYPES
 };
 
+constexpr int kNumOperationTypes = static_cast<int>(OperationType::NUM_TYPES);
+
+// Short name of an operation type, as used in reports.
+const char* operationTypeName(OperationType type);
+
 //
 // Stats: Per-thread statistics
 //
@@ -32,14 +48,33 @@ public:
     Stats();
     ~Stats();
 
+    // Open hardware counters for the calling thread; they are then started
+    // and stopped together with the stats.
+    void enablePerfCounters();
+    // Log every op's start and latency to a per-thread file (--latency_log).
+    Result openLatencyLog(const std::string& path, uint64_t capacity, int thread, const std::string& workload);
     // Initialize or reset stats.
     void start();
-    // Record a single operation.
+    // Mark when the next operation was meant to start. Without it, an op's
+    // latency is measured from the end of the previous one.
+    void markOpStart(uint64_t micros);
+    // Record a single operation. found tells hits from misses.
     void finishedReadOp(uint64_t opBytes, bool found);
     void finishedWriteOp(uint64_t opBytes);
     void finishedDeleteOp(uint64_t opBytes);
+    void finishedScanOp(uint64_t opBytes, bool found);
+    void finishedRmwOp(uint64_t opBytes, bool found);
+    // Record the end of the read half of a read-modify-write. finishedRmwOp
+    // then records the whole op and its write half.
+    void finishedRmwRead();
+    // Record the size of a value handed to the store.
+    void recordValueSize(uint64_t valueBytes);
+    // Record the outcome of verifying a value read back.
+    void finishedVerify(VerifyOutcome outcome);
     // Record a batch of operations.
     void finishedOps(int64_t numOps, uint64_t opBytes);
+    // Record the time spent opening this thread's adapter session.
+    void finishedSessionSetup(uint64_t micros);
     // Finalize stats and compute elapsed time.
     void stop();
     // Report the statistics to stdout.
@@ -50,26 +85,51 @@ public:
     uint64_t getFinish() const;
     uint64_t getOps() const;
     uint64_t getBytes() const;
+    uint64_t getWriteBytes() const;
     double getSeconds() const;
-	std::vector<double> getOpLatencies() const;
+	const std::vector<double>& getOpLatencies() const;
+    const std::vector<uint8_t>& getOpTypes() const;
+    uint64_t getOpCount(OperationType type) const;
+    uint64_t getFound(OperationType type) const;
+    const std::vector<double>& getRmwReadLatencies() const;
+    const std::vector<double>& getRmwWriteLatencies() const;
+    std::vector<double> getValueSizes() const;
+    bool hasSession() const;
+    uint64_t getSessionSetupMicros() const;
+    const PerfCounters* getPerfCounters() const;
+    AllocCounts getAllocs(AllocScope scope) const;
+    uint64_t getVerified(VerifyOutcome outcome) const;
 
     // Merge another Stats object (for combining per-thread results).
     void merge(const Stats& other);
 
 private:
+    void recordOp(OperationType type, bool found);
+
     SimpleClock* clock_;
     uint64_t startTime_;
 	uint64_t lastOpTime_;
     uint64_t finishTime_;
     uint64_t done_;   // total operations
     uint64_t bytes_;  // total bytes processed
+    uint64_t writeBytes_;  // bytes handed to the store by write ops
     double seconds_;
-    int reads_;
-    int writes_;
-    int deletes_;
-    int found_;
+    uint64_t opCounts_[kNumOperationTypes];  // ops by type
+    uint64_t found_[kNumOperationTypes];     // ops by type that found their key
+    bool hasSession_;
+    uint64_t sessionSetupMicros_;
+    std::unique_ptr<PerfCounters> perf_;
+    std::unique_ptr<LatencyLog> latencyLog_;
+    uint64_t lastOpNanos_;            // lastOpTime_ in ns, kept only for the latency log
+    AllocCounts allocs_[2];  // heap allocations by scope, if counted
+    uint64_t verified_[static_cast<int>(VerifyOutcome::NumOutcomes)];  // verified reads by outcome
 	// store individual operation latencies
 	std::vector<double> opLatencies_;
+    std::vector<uint8_t> opTypes_;    // type of every op, parallel to opLatencies_
+    uint64_t rmwReadTime_;            // when the read half of the current RMW ended
+    std::vector<double> rmwReadLatencies_;   // the two halves of every RMW
+    std::vector<double> rmwWriteLatencies_;
+    std::vector<double> valueSizes_;  // size of every value written
 };
 
 //
@@ -81,6 +141,25 @@ public:
     ~CombinedStats();
 
     void addStats(std::unique_ptr<Stats> stat);
+    // Attach the process resources consumed while the workload ran.
+    void setResources(const ResourceUsage& usage);
+    // Attach the harness cost per op measured against a no-op store.
+    void setHarnessNanosPerOp(double nanos);
+    // Attach the footprint of the dataset the workload loaded.
+    void setFootprint(const Footprint& footprint);
+    // Attach what the store reported about the step.
+    void setStoreReport(const std::string& report);
+    // Mean size of the values written, in bytes.
+    double avgValueSize() const;
+    // Mean per-thread throughput, in ops/sec.
+    double avgThroughput() const;
+    // Throughput of all threads together, in ops/sec.
+    double totalThroughput() const;
+    // Latency percentile over every op, in µs.
+    double latencyPercentile(double percentile) const;
+    // Reads that failed verification.
+    uint64_t verifyFailures() const;
+    std::string getBenchName() const;
     void reportFinal() const;
 
 private:
@@ -89,11 +168,31 @@ private:
     double calcStdDev(const std::vector<double>& data, double avg) const;
     double calcPercentile(const std::vector<double>& data, double percentile) const;
     double calcMedian(const std::vector<double>& data) const;
+    void reportOpTypes() const;
+    void reportLatencyLine(const char* name, const std::vector<double>& latencies) const;
 
     std::vector<double> throughputOps_;   // Ops/sec per Stats object.
     std::vector<double> throughputMB_;    // MB/sec per Stats object.
     std::vector<double> opLatencies_;     // Combined per-operation latencies (in microseconds).
+    std::vector<double> typeLatencies_[kNumOperationTypes];  // The same, split by op type.
+    uint64_t opCounts_[kNumOperationTypes] = {};  // Ops by type.
+    uint64_t found_[kNumOperationTypes] = {};     // Ops by type that found their key.
+    std::vector<double> rmwReadLatencies_;        // Read and write halves of the RMW ops.
+    std::vector<double> rmwWriteLatencies_;
+    std::vector<double> sessionSetup_;    // Per-thread session setup time (in microseconds).
+    std::vector<double> valueSizes_;      // Combined sizes of the values written (in bytes).
     std::string benchName_;               // Benchmark name.
+    uint64_t totalOps_ = 0;               // Ops across all threads.
+    uint64_t totalWriteBytes_ = 0;        // Logical bytes written across all threads.
+    ResourceUsage resources_;
+    double harnessNanosPerOp_ = 0;        // 0 when not calibrated.
+    Footprint footprint_;
+    std::string storeReport_;            // KVStore::takeStepReport of the step.
+    bool countedAllocs_ = false;
+    AllocCounts allocs_[2];               // Heap allocations by scope.
+    uint64_t verified_[static_cast<int>(VerifyOutcome::NumOutcomes)] = {};  // Verified reads by outcome.
+    uint64_t perfTotals_[PERF_NUM_EVENTS] = {};  // Summed hardware counters.
+    uint64_t perfOps_[PERF_NUM_EVENTS] = {};     // Ops of the threads each counter covered.
 };
 
 #endif // STATS_H
@@ -0,0 +1,175 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char* category;
+    const char* name;
+    uint64_t start;  // ns, steady clock
+    uint64_t end;
+};
+
+// TraceRing is written by its owning thread only; head is published with
+// release so that the exporter sees complete events.
+struct TraceRing {
+    int id;
+    int workerId;  // -1 for threads the harness did not start
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{0};
+};
+
+std::atomic<bool> Tracer::enabled_{false};
+
+static size_t ringEvents_ = 0;
+static std::mutex ringsMutex_;
+static std::vector<std::unique_ptr<TraceRing>> rings_;
+// The ring of every worker id. Each step starts new worker threads; the one
+// with a given id takes over the ring of the previous one, whose thread has
+// been joined, so that rings do not pile up step after step.
+static std::map<int, TraceRing*> workerRings_;
+
+// Plain thread locals, so that checking them is cheap.
+static thread_local TraceRing* ring_ = nullptr;
+static thread_local bool worker_ = false;
+static thread_local bool sampled_ = false;
+static thread_local int workerId_ = -1;
+
+static uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceRing* threadRing() {
+    if (ring_ == nullptr) {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        auto found = workerRings_.find(workerId_);
+        if (found != workerRings_.end()) {
+            ring_ = found->second;
+            return ring_;
+        }
+        auto ring = std::make_unique<TraceRing>();
+        ring->workerId = workerId_;
+        ring->events.resize(ringEvents_);
+        ring->id = static_cast<int>(rings_.size()) + 1;
+        ring_ = ring.get();
+        if (workerId_ >= 0) {
+            workerRings_[workerId_] = ring_;
+        }
+        rings_.push_back(std::move(ring));
+    }
+    return ring_;
+}
+
+void Tracer::enable(size_t ringEvents) {
+    ringEvents_ = ringEvents;
+    enabled_.store(ringEvents > 0, std::memory_order_relaxed);
+}
+
+void Tracer::setWorkerThread(int workerId) {
+    if (workerId != workerId_) {
+        ring_ = nullptr;
+    }
+    worker_ = true;
+    workerId_ = workerId;
+}
+
+void Tracer::setSampled(bool sampled) {
+    sampled_ = sampled;
+}
+
+uint64_t Tracer::beginSpan() {
+    if (worker_ && !sampled_) {
+        return 0;
+    }
+    return nowNanos();
+}
+
+void Tracer::endSpan(const char* category, const char* name, uint64_t start) {
+    TraceRing* ring = threadRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head % ring->events.size()] = TraceEvent{category, name, start, nowNanos()};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Writes s as a JSON string literal.
+static void writeJsonString(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Copies the spans a ring still holds. Workers are joined by the time the
+// rings are exported, but an adapter's background thread may still write to
+// its ring: the spans it may have overwritten during the copy are dropped.
+static std::vector<TraceEvent> snapshot(const TraceRing& ring) {
+    size_t size = ring.events.size();
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t first = head > size ? head - size : 0;
+    std::vector<TraceEvent> events;
+    for (uint64_t i = first; i < head; i++) {
+        events.push_back(ring.events[i % size]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the writer is at most filling the slot of span head, that of span head - size
+    uint64_t now = ring.head.load(std::memory_order_relaxed);
+    uint64_t intact = now >= size ? now - size + 1 : 0;
+    if (intact > first) {
+        events.erase(events.begin(), events.begin() + std::min<uint64_t>(intact - first, events.size()));
+    }
+    return events;
+}
+
+Result Tracer::exportChrome(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        return Result::Error("Cannot open trace file " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    std::vector<std::vector<TraceEvent>> spans;
+    uint64_t origin = UINT64_MAX;
+    for (const auto& ring : rings_) {
+        spans.push_back(snapshot(*ring));
+        for (const TraceEvent& e : spans.back()) {
+            origin = std::min(origin, e.start);
+        }
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool firstEvent = true;
+    for (size_t r = 0; r < rings_.size(); r++) {
+        const TraceRing& ring = *rings_[r];
+        char threadName[32];
+        if (ring.workerId >= 0) {
+            snprintf(threadName, sizeof(threadName), "worker %d", ring.workerId);
+        } else {
+            snprintf(threadName, sizeof(threadName), "background");
+        }
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                firstEvent ? "" : ",\n", ring.id, threadName);
+        firstEvent = false;
+
+        // Only the last events.size() spans survive in a ring that wrapped.
+        for (const TraceEvent& e : spans[r]) {
+            fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"cat\":", ring.id);
+            writeJsonString(f, e.category);
+            fprintf(f, ",\"name\":");
+            writeJsonString(f, e.name);
+            fprintf(f, ",\"ts\":%.3f,\"dur\":%.3f}", (e.start - origin) / 1000.0, (e.end - e.start) / 1000.0);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return Result::OK();
+}
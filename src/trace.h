@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "result.h"
+
+//
+// Tracer: lightweight span tracing shared by the harness and the adapters.
+//
+// Every thread records into its own fixed-size ring, so recording never
+// takes a lock; the worker threads of later steps reuse the rings of the
+// earlier ones with the same worker id. Worker threads only record while the harness has sampled
+// the current op (one op in N), which keeps adapter spans aligned with the
+// harness op that caused them; other threads, e.g. an adapter's background
+// compaction, record all their spans. When tracing is off a span costs a
+// single relaxed load.
+//
+class Tracer {
+public:
+    // Turns tracing on, with room for ringEvents spans per thread.
+    static void enable(size_t ringEvents);
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // Called by the harness on its worker threads.
+    static void setWorkerThread(int workerId);
+    static void setSampled(bool sampled);
+
+    // Returns the span start time, or 0 if the calling thread is not
+    // recording right now.
+    static uint64_t beginSpan();
+    // Records a span. category and name must outlive the tracer, so pass
+    // string literals.
+    static void endSpan(const char* category, const char* name, uint64_t start);
+
+    // Writes all recorded spans in Chrome trace-event JSON, which can be
+    // opened in Perfetto or chrome://tracing. Call it once the worker
+    // threads have been joined.
+    static Result exportChrome(const std::string& path);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// TraceSpan records the lifetime of a scope as an adapter span:
+//
+//   Result MyAdapter::put(...) {
+//       TraceSpan span("wal_append");
+//       ...
+//   }
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name_(name), start_(Tracer::enabled() ? Tracer::beginSpan() : 0) {}
+    ~TraceSpan() {
+        if (start_ != 0) {
+            Tracer::endSpan("adapter", name_, start_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+#endif // TRACE_H
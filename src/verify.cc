@@ -0,0 +1,105 @@
+#include "verify.h"
+
+#include <cstring>
+
+// Slots of the table of this thread's latest writes; a power of two.
+static constexpr size_t kWrittenSlots = 4096;
+
+// The sequence number is tid (16 bits) | epoch (16 bits) | count (32 bits).
+static constexpr int kTidShift = 48;
+static constexpr int kEpochShift = 32;
+
+static uint64_t load64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void store64(char *p, uint64_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+static uint64_t round64(uint64_t h, uint64_t word) {
+    h ^= word;
+    return ((h << 31) | (h >> 33)) * 0x4cf5ad432745937fULL;
+}
+
+// Multiply-rotate hash over 8-byte words, with four independent lanes so that
+// the multiplications of a 32-byte block overlap.
+static uint64_t hashBytes(const char *p, size_t n, uint64_t seed) {
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL);
+    if (n >= 32) {
+        uint64_t h0 = h, h1 = h + 1, h2 = h + 2, h3 = h + 3;
+        for (; n >= 32; p += 32, n -= 32) {
+            h0 = round64(h0, load64(p));
+            h1 = round64(h1, load64(p + 8));
+            h2 = round64(h2, load64(p + 16));
+            h3 = round64(h3, load64(p + 24));
+        }
+        h = mix(h0) ^ mix(h1 + 1) ^ mix(h2 + 2) ^ mix(h3 + 3);
+    }
+    for (; n >= 8; p += 8, n -= 8) {
+        h = round64(h, load64(p));
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, n);
+    return mix(h ^ tail);
+}
+
+static uint64_t keyHash(const std::string &key) {
+    return hashBytes(key.data(), key.size(), 0);
+}
+
+// The checksum covers the key hash, the sequence number and the payload.
+static uint64_t checksum(const std::string &value) {
+    uint64_t h = hashBytes(value.data() + ValueVerifier::kHeaderSize,
+                           value.size() - ValueVerifier::kHeaderSize, load64(value.data()));
+    return mix(h ^ load64(value.data() + 8));
+}
+
+ValueVerifier::ValueVerifier(int tid, uint64_t epoch)
+    : tid_(static_cast<uint64_t>(tid) & 0xffff),
+      nextSeq_((tid_ << kTidShift) | ((epoch & 0xffff) << kEpochShift)),
+      last_{0, 0},
+      written_(kWrittenSlots, Written{0, 0}) {}
+
+void ValueVerifier::stamp(const std::string &key, const std::string &value, std::string *out) {
+    out->assign(value);
+    if (out->size() < kHeaderSize) {
+        out->resize(kHeaderSize);
+    }
+    last_ = Written{keyHash(key), ++nextSeq_};
+    char *p = &(*out)[0];
+    store64(p, last_.keyHash);
+    store64(p + 8, last_.seq);
+    store64(p + 16, checksum(*out));
+}
+
+void ValueVerifier::committed() {
+    written_[last_.keyHash & (kWrittenSlots - 1)] = last_;
+}
+
+VerifyOutcome ValueVerifier::check(const std::string &key, const std::string &value) const {
+    if (value.size() < kHeaderSize || load64(value.data() + 16) != checksum(value)) {
+        return VerifyOutcome::Corrupt;
+    }
+    uint64_t hash = keyHash(key);
+    if (load64(value.data()) != hash) {
+        return VerifyOutcome::KeyMismatch;
+    }
+    // Only this thread's own writes are ordered against its reads.
+    uint64_t seq = load64(value.data() + 8);
+    const Written &w = written_[hash & (kWrittenSlots - 1)];
+    if (w.keyHash == hash && w.seq != 0 && (seq >> kTidShift) == tid_ && seq < w.seq) {
+        return VerifyOutcome::Stale;
+    }
+    return VerifyOutcome::Ok;
+}
@@ -0,0 +1,235 @@
+#include "workload_spec.h"
+
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <set>
+
+bool parseKeyDistribution(const std::string &name, DistributionType &type) {
+    static const std::map<std::string, DistributionType> names = {
+        {"uniform", DistributionType::Uniform},
+        {"normal", DistributionType::Normal},
+        {"zipfian", DistributionType::Zipfian},
+        {"latest", DistributionType::Latest},
+        {"hotspot", DistributionType::Hotspot},
+        {"shifting_hotspot", DistributionType::ShiftingHotspot},
+        {"drifting_zipfian", DistributionType::DriftingZipfian},
+        {"sequential", DistributionType::Sequential},
+    };
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return false;
+    }
+    type = it->second;
+    return true;
+}
+
+bool parseValueSizeDistribution(const std::string &name, DistributionType &type) {
+    static const std::map<std::string, DistributionType> names = {
+        {"fixed", DistributionType::Fixed},
+        {"constant", DistributionType::Fixed},
+        {"uniform", DistributionType::Uniform},
+        {"normal", DistributionType::Normal},
+        {"zipfian", DistributionType::Zipfian},
+        {"pareto", DistributionType::Pareto},
+        {"histogram", DistributionType::Empirical},
+    };
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return false;
+    }
+    type = it->second;
+    return true;
+}
+
+static std::string trim(const std::string &s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+// Workload names end up in --workload, so they must not contain its separators.
+static bool validName(const std::string &name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A property as read from the file, with its line for error messages.
+struct Property {
+    std::string key;
+    std::string value;
+    int line;
+};
+
+static Result applyProperty(const Property &p, WorkloadSpec &spec) {
+    static const std::map<std::string, SpecOp> proportions = {
+        {"readproportion", SpecOp::READ},
+        {"updateproportion", SpecOp::UPDATE},
+        {"insertproportion", SpecOp::INSERT},
+        {"scanproportion", SpecOp::SCAN},
+        {"deleteproportion", SpecOp::DELETE},
+        {"readmodifywriteproportion", SpecOp::RMW},
+    };
+    static const std::set<std::string> ignored = {
+        "workload", "fieldcount", "readallfields", "writeallfields", "insertorder",
+    };
+
+    try {
+        auto proportion = proportions.find(p.key);
+        if (proportion != proportions.end()) {
+            double value = std::stod(p.value);
+            if (value < 0) {
+                return Result::Error("negative proportion");
+            }
+            spec.proportions[static_cast<int>(proportion->second)] = value;
+        } else if (p.key == "requestdistribution") {
+            if (!parseKeyDistribution(p.value, spec.keyDistribution)) {
+                return Result::Error("unknown request distribution " + p.value);
+            }
+        } else if (p.key == "recordcount") {
+            spec.recordCount = std::stoull(p.value);
+        } else if (p.key == "operationcount") {
+            spec.operationCount = std::stoull(p.value);
+        } else if (p.key == "load") {
+            spec.load = p.value == "true" || p.value == "1";
+        } else if (p.key == "minscanlength") {
+            spec.minScanLength = std::stoull(p.value);
+        } else if (p.key == "maxscanlength") {
+            spec.maxScanLength = std::stoull(p.value);
+        } else if (p.key == "scanlengthdistribution") {
+            if (p.value == "uniform") {
+                spec.scanLengthDistribution = DistributionType::Uniform;
+            } else if (p.value == "zipfian") {
+                spec.scanLengthDistribution = DistributionType::Zipfian;
+            } else {
+                return Result::Error("unknown scan length distribution " + p.value);
+            }
+        } else if (p.key == "deleteorder") {
+            if (p.value == "random" || p.value == "oldest") {
+                spec.deleteOldest = p.value == "oldest";
+            } else {
+                return Result::Error("unknown delete order " + p.value);
+            }
+        } else if (p.key == "massdeletefraction") {
+            spec.massDeleteFraction = std::stod(p.value);
+        } else if (p.key == "fieldlength") {
+            spec.valueSize = std::stoi(p.value);
+        } else if (p.key == "fieldlengthdistribution") {
+            if (!parseValueSizeDistribution(p.value, spec.valueDistribution)) {
+                return Result::Error("unknown field length distribution " + p.value);
+            }
+            spec.hasValueDistribution = true;
+        } else if (p.key == "threadcount") {
+            spec.threads = std::stoi(p.value);
+        } else if (p.key == "target") {
+            spec.target = std::stod(p.value);
+        } else if (p.key == "tracefile") {
+            spec.replayTrace = p.value;
+        } else if (p.key == "tracetiming") {
+            if (p.value == "fast" || p.value == "original") {
+                spec.replayOriginalTiming = p.value == "original";
+            } else {
+                return Result::Error("unknown trace timing " + p.value);
+            }
+        } else if (ignored.count(p.key) == 0) {
+            return Result::Error("unknown property " + p.key);
+        }
+    } catch (const std::exception &) {
+        return Result::Error("invalid value for " + p.key);
+    }
+    return Result::OK();
+}
+
+// Checks a spec once all its properties are applied.
+static Result validateSpec(const WorkloadSpec &spec) {
+    double total = 0;
+    for (double proportion : spec.proportions) {
+        total += proportion;
+    }
+    if (total <= 0 && spec.replayTrace.empty()) {
+        return Result::Error("workload " + spec.name + " has no operations");
+    }
+    if (spec.minScanLength == 0 || spec.maxScanLength < spec.minScanLength) {
+        return Result::Error("workload " + spec.name + " has invalid scan lengths");
+    }
+    if (spec.massDeleteFraction < 0 || spec.massDeleteFraction > 1) {
+        return Result::Error("workload " + spec.name + " has a massdeletefraction outside [0, 1]");
+    }
+    if (spec.threads < 0 || spec.target < 0 || spec.valueSize < 0) {
+        return Result::Error("workload " + spec.name + " has a negative threadcount, target or fieldlength");
+    }
+    return Result::OK();
+}
+
+Result loadWorkloadSpecs(const std::string &path, std::vector<WorkloadSpec> &specs) {
+    std::ifstream in(path);
+    if (!in) {
+        return Result::Error("Cannot open workload file " + path);
+    }
+
+    std::vector<Property> common;
+    std::vector<std::pair<std::string, std::vector<Property>>> sections;
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') {
+            std::string name = line.back() == ']' ? trim(line.substr(1, line.size() - 2)) : "";
+            if (!validName(name)) {
+                return Result::Error(path + ":" + std::to_string(lineNo) + ": invalid section " + line);
+            }
+            sections.push_back({name, {}});
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            return Result::Error(path + ":" + std::to_string(lineNo) + ": expected property=value");
+        }
+        Property p{trim(line.substr(0, eq)), trim(line.substr(eq + 1)), lineNo};
+        (sections.empty() ? common : sections.back().second).push_back(p);
+    }
+
+    if (sections.empty()) {
+        // a single workload, named after the file
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        name = name.substr(0, name.find('.'));
+        if (!validName(name)) {
+            return Result::Error("Cannot name a workload after " + path + "; put it in a [section]");
+        }
+        sections.push_back({name, {}});
+    }
+
+    specs.clear();
+    for (const auto &section : sections) {
+        WorkloadSpec spec;
+        spec.name = section.first;
+        std::vector<Property> properties = common;
+        properties.insert(properties.end(), section.second.begin(), section.second.end());
+        for (const auto &p : properties) {
+            auto r = applyProperty(p, spec);
+            if (!r.ok()) {
+                return Result::Error(path + ":" + std::to_string(p.line) + ": " + r.message());
+            }
+        }
+        auto r = validateSpec(spec);
+        if (!r.ok()) {
+            return Result::Error(path + ": " + r.message());
+        }
+        specs.push_back(spec);
+    }
+    return Result::OK();
+}
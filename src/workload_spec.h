@@ -0,0 +1,73 @@
+#ifndef WORKLOAD_SPEC_H
+#define WORKLOAD_SPEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "distribution.h"
+#include "result.h"
+
+// The operations a workload mixes.
+enum class SpecOp {
+    READ,
+    UPDATE,
+    INSERT,   // a new key at the insert frontier
+    SCAN,
+    DELETE,
+    RMW,      // read-modify-write
+    NUM_OPS
+};
+
+constexpr int kNumSpecOps = static_cast<int>(SpecOp::NUM_OPS);
+
+//
+// WorkloadSpec: a workload as data. The built-in workloads are specs, and
+// more can be read from files (--workload_file); all of them run through the
+// same op loop.
+//
+struct WorkloadSpec {
+    std::string name;
+    double proportions[kNumSpecOps] = {};   // relative weight of each op
+    DistributionType keyDistribution = DistributionType::Uniform;
+    uint64_t recordCount = 0;      // keyspace, 0 for --num
+    uint64_t operationCount = 0;   // ops per thread, 0 for the default
+    bool load = false;             // ops default to the record count rather than --ops
+    uint64_t minScanLength = 1;
+    uint64_t maxScanLength = 100;
+    DistributionType scanLengthDistribution = DistributionType::Uniform;
+    bool deleteOldest = false;     // deletes take the oldest live key rather than a random one
+    double massDeleteFraction = 0; // share of the keyspace, from key 0, deleted before the ops
+    bool hasValueDistribution = false;   // false to use --distribution
+    DistributionType valueDistribution = DistributionType::Fixed;
+    int valueSize = 0;             // 0 for --value_size
+    int threads = 0;               // 0 for --threads
+    double target = 0;             // ops/sec of all threads together, 0 for no limit
+    std::string replayTrace;       // op trace to replay instead of generating ops
+    bool replayOriginalTiming = false;   // replay at the recorded pace rather than flat out
+};
+
+// Names accepted for key distributions: uniform, normal, zipfian, latest,
+// hotspot, shifting_hotspot, drifting_zipfian and sequential.
+bool parseKeyDistribution(const std::string &name, DistributionType &type);
+// Names accepted for value size distributions: fixed (or constant), uniform,
+// normal, zipfian, pareto and histogram.
+bool parseValueSizeDistribution(const std::string &name, DistributionType &type);
+
+// Reads workload specs from a file of YCSB-style "property=value" lines.
+// Each [name] section is one workload; properties before the first section
+// apply to all of them. A file without sections is a single workload named
+// after the file. Sections keep their file order, so they can be used as
+// the phases of a run.
+//
+// Properties: readproportion, updateproportion, insertproportion,
+// scanproportion, deleteproportion, readmodifywriteproportion,
+// requestdistribution, recordcount, operationcount (per thread), load,
+// minscanlength, maxscanlength, scanlengthdistribution, deleteorder (random
+// or oldest), massdeletefraction, fieldlength, fieldlengthdistribution,
+// threadcount, target, tracefile (an op trace to replay, see op_trace.h) and
+// tracetiming (fast or original). The YCSB properties workload, fieldcount,
+// readallfields, writeallfields and insertorder are accepted and ignored.
+Result loadWorkloadSpecs(const std::string &path, std::vector<WorkloadSpec> &specs);
+
+#endif // WORKLOAD_SPEC_H
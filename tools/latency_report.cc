@@ -0,0 +1,134 @@
+// latency_report: merges the per-thread latency logs of a run (--latency_log)
+// and reports the slowest ops with when they happened, and the maximum
+// latency of every second, to see whether slow ops cluster.
+//
+//   latency_report [--top=N] <log>...
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "latency_log.h"
+#include "stats.h"
+
+// One op, and the log it came from.
+struct LoggedOp {
+    uint64_t startNanos;
+    uint64_t latencyNanos;
+    int opType;
+    size_t log;
+};
+
+// Ops and worst latency of one second of the run.
+struct Second {
+    uint64_t ops = 0;
+    uint64_t maxNanos = 0;
+    size_t maxLog = 0;
+};
+
+static bool slower(const LoggedOp& a, const LoggedOp& b) {
+    return a.latencyNanos > b.latencyNanos;
+}
+
+static const char* opName(int type) {
+    if (type < 0 || type >= kNumOperationTypes) {
+        return "?";
+    }
+    return operationTypeName(static_cast<OperationType>(type));
+}
+
+int main(int argc, char* argv[]) {
+    size_t top = 20;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.find("--top=") == 0) {
+            top = std::stoul(arg.substr(6));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: latency_report [--top=N] <log>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<LatencyLogReader>> logs;
+    uint64_t origin = UINT64_MAX;
+    for (const auto& path : paths) {
+        auto log = std::make_unique<LatencyLogReader>();
+        Result r = log->open(path);
+        if (!r.ok()) {
+            std::cerr << "Error: " << r.message() << std::endl;
+            return 1;
+        }
+        if (log->size() > 0) {
+            origin = std::min(origin, log->record(0).startNanos);
+        }
+        logs.push_back(std::move(log));
+    }
+    if (origin == UINT64_MAX) {
+        printf("No ops logged\n");
+        return 0;
+    }
+
+    // a min-heap of the slowest ops seen so far, and the per-second series
+    std::priority_queue<LoggedOp, std::vector<LoggedOp>, decltype(&slower)> slowest(slower);
+    std::map<uint64_t, Second> seconds;
+    uint64_t total = 0;
+    for (size_t l = 0; l < logs.size(); l++) {
+        const LatencyLogReader& log = *logs[l];
+        for (uint64_t i = 0; i < log.size(); i++) {
+            const LatencyRecord& record = log.record(i);
+            LoggedOp op{record.startNanos, record.latencyNanos(), record.opType(), l};
+            if (top > 0 && (slowest.size() < top || slower(op, slowest.top()))) {
+                slowest.push(op);
+                if (slowest.size() > top) {
+                    slowest.pop();
+                }
+            }
+            Second& second = seconds[(op.startNanos - std::min(origin, op.startNanos)) / 1000000000];
+            second.ops++;
+            if (op.latencyNanos >= second.maxNanos) {
+                second.maxNanos = op.latencyNanos;
+                second.maxLog = l;
+            }
+            total++;
+        }
+        if (log.header().count > log.size()) {
+            fprintf(stderr, "%s: ring wrapped, only its last %llu of %llu ops are kept\n", paths[l].c_str(),
+                    static_cast<unsigned long long>(log.size()),
+                    static_cast<unsigned long long>(log.header().count));
+        }
+    }
+
+    std::vector<LoggedOp> ops;
+    while (!slowest.empty()) {
+        ops.push_back(slowest.top());
+        slowest.pop();
+    }
+    std::reverse(ops.begin(), ops.end());
+
+    printf("==== Latency logs: %llu ops from %zu threads ====\n", static_cast<unsigned long long>(total), logs.size());
+    printf("Slowest %zu ops:\n", ops.size());
+    printf("   %12s %15s  %-6s %6s  %s\n", "time (s)", "latency (µs)", "op", "thread", "workload");
+    for (const auto& op : ops) {
+        const LatencyLogHeader& header = logs[op.log]->header();
+        printf("   %12.6f %14.3f  %-6s %6d  %s\n", (op.startNanos - origin) / 1e9, op.latencyNanos / 1e3,
+               opName(op.opType), header.thread, header.workload);
+    }
+    printf("Max latency per second:\n");
+    printf("   %8s %10s %15s  %s\n", "second", "ops", "max (µs)", "workload");
+    for (const auto& entry : seconds) {
+        printf("   %8llu %10llu %14.3f  %s\n", static_cast<unsigned long long>(entry.first),
+               static_cast<unsigned long long>(entry.second.ops), entry.second.maxNanos / 1e3,
+               logs[entry.second.maxLog]->header().workload);
+    }
+    printf("========================\n");
+    return 0;
+}